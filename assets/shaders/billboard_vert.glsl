@@ -1,8 +1,10 @@
 #version 460 core
 
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in uvec2 aTexCoord;
-layout (location = 2) in int aDirection;
+// The mesh is one PackedBillboard per billboard block (see Vertex.h), each drawn as two quads of four indexed vertices
+layout (std430, binding = 0) readonly buffer Billboards
+{
+	uint billboards[];
+};
 
 out vec2 TexCoord;
 out vec3 Normal;
@@ -13,8 +15,22 @@ uniform vec3 models[768];
 uniform mat4 view;
 uniform mat4 projection;
 
+// Where each quad's corners are across the block, the quads run along its two diagonals
+const vec2 corners[] = vec2[](
+	vec2(.85355, .85355), vec2(.14645, .14645), vec2(.85355, .85355), vec2(.14645, .14645),
+	vec2(.14645, .85355), vec2(.85355, .14645), vec2(.14645, .85355), vec2(.85355, .14645)
+);
+
 void main()
 {
-	gl_Position = projection * view * vec4(models[gl_BaseInstance] + aPos, 1.0);
-	TexCoord = aTexCoord * texMultiplier;
+	uint billboard = billboards[gl_VertexID >> 3];
+	int corner = gl_VertexID & 3;
+
+	vec2 across = corners[gl_VertexID & 7];
+	vec3 pos = vec3(bitfieldExtract(billboard, 0, 5), bitfieldExtract(billboard, 5, 9), bitfieldExtract(billboard, 14, 5));
+	pos += vec3(across.x, corner >> 1, across.y);
+	vec2 tile = vec2(bitfieldExtract(billboard, 19, 6), bitfieldExtract(billboard, 25, 6));
+
+	gl_Position = projection * view * vec4(models[gl_BaseInstance] + pos, 1.0);
+	TexCoord = (tile + vec2(corner & 1, corner >> 1)) * texMultiplier;
 }
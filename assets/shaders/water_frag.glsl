@@ -1,11 +1,14 @@
 #version 330 core
 
-in vec2 TexCoord;
+// TexCoord is the tile's corner, FaceCoord counts blocks across the face so the tile repeats per block
+flat in vec2 TexCoord;
+in vec2 FaceCoord;
 in vec3 Normal;
 
 out vec4 FragColor;
 
 uniform sampler2D tex;
+uniform float texMultiplier;
 
 vec3 ambient = vec3(.5);
 vec3 lightDirection = vec3(0.8, 1, 0.7);
@@ -19,7 +22,7 @@ void main()
 
 	vec4 result = vec4(ambient + diffuse, 1.0);
 
-	vec4 texResult = texture(tex, TexCoord);
+	vec4 texResult = texture(tex, TexCoord + fract(FaceCoord) * texMultiplier);
 	if (texResult.a == 0)
 		discard;
 	FragColor = texResult * result;
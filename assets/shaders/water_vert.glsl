@@ -1,10 +1,13 @@
 #version 460 core
 
-layout (location = 0) in uvec3 aPos;
-layout (location = 1) in uvec2 aTexCoord;
-layout (location = 2) in int aDirection;
+// The mesh is one PackedQuad per quad (see Vertex.h), each drawn as four indexed vertices
+layout (std430, binding = 0) readonly buffer Quads
+{
+	uvec2 quads[];
+};
 
-out vec2 TexCoord;
+flat out vec2 TexCoord;
+out vec2 FaceCoord;
 out vec3 Normal;
 
 uniform float texMultiplier;
@@ -25,22 +28,47 @@ const vec3 normals[] = vec3[](
 	vec3( 0, -1,  0)  // 6
 );
 
+// Corners of a single block face per direction, the last is the underside of a liquid's top. A quad stretches
+// them by its width and height along the direction's axes, the same ones Chunk.cpp merges faces along.
+const ivec3 corners[] = ivec3[](
+	ivec3(1, 0, 0), ivec3(0, 0, 0), ivec3(1, 1, 0), ivec3(0, 1, 0), // North
+	ivec3(0, 0, 1), ivec3(1, 0, 1), ivec3(0, 1, 1), ivec3(1, 1, 1), // South
+	ivec3(0, 0, 0), ivec3(0, 0, 1), ivec3(0, 1, 0), ivec3(0, 1, 1), // West
+	ivec3(1, 0, 1), ivec3(1, 0, 0), ivec3(1, 1, 1), ivec3(1, 1, 0), // East
+	ivec3(1, 0, 1), ivec3(0, 0, 1), ivec3(1, 0, 0), ivec3(0, 0, 0), // Bottom
+	ivec3(0, 1, 1), ivec3(1, 1, 1), ivec3(0, 1, 0), ivec3(1, 1, 0), // Top
+	ivec3(1, 1, 1), ivec3(0, 1, 1), ivec3(1, 1, 0), ivec3(0, 1, 0)  // Underside
+);
+const int widthAxes[] = int[](0, 0, 2, 2, 0, 0, 0);
+const int heightAxes[] = int[](1, 1, 1, 1, 2, 2, 2);
 const int aFrames = 32;
 const float animationTime = 5;
 const int texNum = 16;
 void main()
 {
-	vec3 pos = aPos;
-	if (aDirection == 5)
+	uvec2 quad = quads[gl_VertexID >> 2];
+	int corner = gl_VertexID & 3;
+	int direction = int(bitfieldExtract(quad.x, 19, 3));
+	ivec2 size = ivec2(bitfieldExtract(quad.x, 22, 5), bitfieldExtract(quad.x, 27, 5)) + 1;
+
+	ivec3 offset = corners[direction * 4 + corner];
+	offset[widthAxes[direction]] *= size.x;
+	offset[heightAxes[direction]] *= size.y;
+	vec3 pos = vec3(bitfieldExtract(quad.x, 0, 5), bitfieldExtract(quad.x, 5, 9), bitfieldExtract(quad.x, 14, 5)) + offset;
+	vec2 tile = vec2(bitfieldExtract(quad.y, 0, 8), bitfieldExtract(quad.y, 8, 8));
+
+	// Both sides of the surface move with the waves
+	if (direction >= 5)
 	{
 		pos.y -= .1;
 		pos.y += (sin(pos.x * 3.1415926535 / 2 + time) + sin(pos.z * 3.1415926535 / 2 + time * 1.5)) * .05;
 	}
 	gl_Position = projection * view * vec4(models[gl_BaseInstance] + pos, 1.0);
-	vec2 currentTex = aTexCoord;
+	vec2 currentTex = tile;
 	currentTex.x += mod(floor(mod(time / animationTime, 1) * aFrames), texNum);
 	currentTex.y += floor(floor(mod(time / animationTime, 1) * aFrames) / texNum);
 	TexCoord = currentTex * texMultiplier;
+	FaceCoord = vec2(corner & 1, corner >> 1) * size;
 
-	Normal = normals[aDirection];
+	Normal = normals[direction];
 }
\ No newline at end of file
@@ -29,6 +29,8 @@
 #include "Planet.h"
 #include "Blocks.h"
 #include "Physics.h"
+#include "Benchmark.h"
+#include "utils/SlabPool.h"
 
 #include <glad/glad.h>
 
@@ -225,6 +227,12 @@ int main(int argc, char *argv[])
 	free(resolved_path);
 #endif
 
+	if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+	{
+		Benchmark::Run();
+		return 0;
+	}
+
 	// Load Texture
 	stbi_set_flip_vertically_on_load(true);
 
@@ -644,6 +652,25 @@ int main(int argc, char *argv[])
 			//if (ImGui::SliderInt("Render Height", &Planet::planet->renderHeight, 0, 10))
 			//	Planet::planet->ClearChunkQueue();
 			ImGui::Checkbox("Show chunk borders", &showChunkBorders);
+			if (ImGui::Checkbox("Greedy meshing", &Planet::planet->greedyMeshing))
+				Planet::planet->RemeshChunks();
+			ImGui::Checkbox("Wait for neighbours before meshing", &Planet::planet->waitForNeighbours);
+			ImGui::SliderFloat("Neighbour wait (s)", &Planet::planet->neighbourTimeout, 0.0f, 10.0f);
+			size_t meshedChunks = Planet::planet->meshedChunks;
+			ImGui::Text("Meshes per chunk: %.2f (%.2f only border strips)",
+				meshedChunks ? (float)Planet::planet->meshJobs / meshedChunks : 0.0f, meshedChunks ? (float)Planet::planet->borderMeshJobs / meshedChunks : 0.0f);
+			ImGui::SeparatorText("Chunk memory");
+			ImGui::Checkbox("Compress cold chunks", &Planet::planet->compressChunks);
+			ImGui::SliderFloat("Compress after (s)", &Planet::planet->compressAfter, 1.0f, 120.0f);
+			ImGui::SliderInt("Keep decompressed within", &Planet::planet->compressDistance, 0, 32);
+			ImGui::SliderInt("Memory budget (MiB)", &Planet::planet->memoryBudgetMB, 64, 16384);
+			ImGui::Text("Resident: %.1f MiB / %d MiB", Planet::planet->chunkMemoryUsage / (1024.0f * 1024.0f), Planet::planet->memoryBudgetMB);
+			ImGui::Text("Compressed: %d chunks, %.1f MiB -> %.1f MiB (%.1fx)", Planet::planet->numChunksCompressed,
+				Planet::planet->compressedSourceMemoryUsage / (1024.0f * 1024.0f), Planet::planet->compressedMemoryUsage / (1024.0f * 1024.0f),
+				Planet::planet->compressedMemoryUsage ? (float)Planet::planet->compressedSourceMemoryUsage / Planet::planet->compressedMemoryUsage : 0.0f);
+			ImGui::Text("Block pool: %.1f MiB in use, %.1f MiB peak, %.1f MiB reserved, %.0f%% reused",
+				SlabPool::Get().GetBytesInUse() / (1024.0f * 1024.0f), SlabPool::Get().GetHighWaterMark() / (1024.0f * 1024.0f),
+				SlabPool::Get().GetBytesReserved() / (1024.0f * 1024.0f), SlabPool::Get().GetReuseRate() * 100.0);
 			ImGui::Checkbox("Use absolute Y axis for camera vertical movement", &camera.absoluteVerticalMovement);
 			ImGui::End();
 		}
@@ -0,0 +1,310 @@
+#include "Benchmark.h"
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <random>
+#include <vector>
+#include <fmt/printf.h>
+#include <tracy/Tracy.hpp>
+
+#include "ChunkData.h"
+#include "WorldGen.h"
+#include "utils/SlabPool.h"
+
+namespace
+{
+	constexpr int BENCHMARK_CHUNKS = 4; // Per axis
+	constexpr int BENCHMARK_HEIGHT = 128; // Lookups stay below this, where the terrain is
+	constexpr int BENCHMARK_LOOKUPS = 1000000;
+	constexpr int BENCHMARK_LIST_LOOKUPS = 20000; // The list walk is too slow for the full count
+	constexpr int BENCHMARK_ROUND_TRIPS = 20;
+	constexpr int BENCHMARK_RAYS = 200000;
+
+	template<typename Func>
+	double TimeMs(Func&& func)
+	{
+		auto start = std::chrono::steady_clock::now();
+		func();
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	void PrintResult(const char* name, double ms, int count)
+	{
+		fmt::printf("  %-40s %10.3f ms %10.1f ns/op\n", name, ms, ms * 1000000.0 / count);
+	}
+
+	// Whole-chunk linked list of runs that compressed chunks used to be stored as, kept to compare against.
+	struct ListRuns
+	{
+		struct Run
+		{
+			uint16_t size;
+			uint16_t blockId;
+		};
+		std::list<Run> runs;
+
+		ListRuns(ChunkData& chunkData)
+		{
+			runs.push_back({ 1, chunkData.GetBlock(0) });
+			for (int i = 1; i < CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_WIDTH; i++)
+			{
+				uint16_t blockId = chunkData.GetBlock(i);
+				if (runs.back().size == UINT16_MAX || runs.back().blockId != blockId)
+					runs.push_back({ 1, blockId });
+				else
+					runs.back().size++;
+			}
+		}
+
+		uint16_t GetBlock(int index) const
+		{
+			int i = 0;
+			for (const Run& run : runs)
+			{
+				if (i + run.size > index)
+					return run.blockId;
+				i += run.size;
+			}
+			return 0;
+		}
+	};
+
+	std::vector<std::unique_ptr<ChunkData>> GenerateChunks()
+	{
+		ZoneScoped;
+
+		std::vector<std::unique_ptr<ChunkData>> chunks;
+		for (int x = 0; x < BENCHMARK_CHUNKS; x++)
+		{
+			for (int z = 0; z < BENCHMARK_CHUNKS; z++)
+			{
+				chunks.emplace_back(std::make_unique<ChunkData>());
+				WorldGen::GenerateChunkData({ x, 0, z }, chunks.back().get());
+			}
+		}
+		return chunks;
+	}
+
+	std::vector<int> RandomIndices(int count)
+	{
+		std::mt19937 rng(1234);
+		std::uniform_int_distribution<int> dist(0, CHUNK_WIDTH * BENCHMARK_HEIGHT * CHUNK_WIDTH - 1);
+		std::vector<int> indices(count);
+		for (int& index : indices)
+			index = dist(rng);
+		return indices;
+	}
+
+	void CompressedAccess(std::vector<std::unique_ptr<ChunkData>>& chunks)
+	{
+		ZoneScoped;
+		fmt::printf("Compressed random access (%i chunks, y < %i)\n", (int)chunks.size(), BENCHMARK_HEIGHT);
+
+		std::vector<int> indices = RandomIndices(BENCHMARK_LOOKUPS);
+		volatile uint32_t sink = 0;
+
+		size_t listRuns = 0, listBytes = 0;
+		double listMs = 0;
+		for (auto& chunkData : chunks)
+		{
+			ListRuns list(*chunkData);
+			listRuns += list.runs.size();
+			listBytes += list.runs.size() * (sizeof(ListRuns::Run) + 2 * sizeof(void*));
+			listMs += TimeMs([&]() {
+				uint32_t sum = 0;
+				for (int i = 0; i < BENCHMARK_LIST_LOOKUPS; i++)
+					sum += list.GetBlock(indices[i]);
+				sink = sink + sum;
+			});
+		}
+
+		double uncompressedMs = 0;
+		size_t uncompressedBytes = 0;
+		for (auto& chunkData : chunks)
+		{
+			uncompressedBytes += chunkData->GetMemoryUsage();
+			uncompressedMs += TimeMs([&]() {
+				uint32_t sum = 0;
+				for (int index : indices)
+					sum += chunkData->GetBlock(index);
+				sink = sink + sum;
+			});
+		}
+
+		double compressMs = 0, compressedMs = 0, editMs = 0;
+		size_t compressedBytes = 0;
+		for (auto& chunkData : chunks)
+		{
+			compressMs += TimeMs([&]() { chunkData->Compress(); });
+			compressedBytes += chunkData->GetMemoryUsage();
+			compressedMs += TimeMs([&]() {
+				uint32_t sum = 0;
+				for (int index : indices)
+					sum += chunkData->GetBlock(index);
+				sink = sink + sum;
+			});
+			editMs += TimeMs([&]() {
+				for (int i = 0; i < BENCHMARK_LIST_LOOKUPS; i++)
+					chunkData->SetBlock(indices[i], (uint16_t)(i & 3));
+			});
+		}
+
+		int chunkCount = (int)chunks.size();
+		PrintResult("std::list runs GetBlock", listMs, BENCHMARK_LIST_LOOKUPS * chunkCount);
+		PrintResult("Run array GetBlock", compressedMs, BENCHMARK_LOOKUPS * chunkCount);
+		PrintResult("Run array SetBlock", editMs, BENCHMARK_LIST_LOOKUPS * chunkCount);
+		PrintResult("Paletted GetBlock", uncompressedMs, BENCHMARK_LOOKUPS * chunkCount);
+		PrintResult("Compress", compressMs, chunkCount);
+		fmt::printf("  std::list: %zu runs, %zu KiB\n", listRuns, listBytes / 1024);
+		fmt::printf("  Run array: %zu KiB, paletted: %zu KiB\n", compressedBytes / 1024, uncompressedBytes / 1024);
+	}
+
+	// Access patterns that depend on how blocks are laid out in sections, rebuild with a different
+	// SCUFFED_SECTION_LAYOUT to compare.
+	void LayoutThroughput(std::vector<std::unique_ptr<ChunkData>>& chunks, double generationMs)
+	{
+		ZoneScoped;
+		fmt::printf("Section layout: %s (%i chunks)\n", SectionLayout::NAME, (int)chunks.size());
+
+		volatile uint32_t sink = 0;
+
+		// Six neighbour reads per block, what the mesher used to do
+		int meshBlocks = 0;
+		double meshMs = TimeMs([&]() {
+			uint32_t faces = 0;
+			for (auto& chunkData : chunks)
+			{
+				int height = chunkData->GetMaxHeight();
+				for (int y = 0; y <= height; y++)
+				{
+					for (int z = 0; z < CHUNK_WIDTH; z++)
+					{
+						for (int x = 0; x < CHUNK_WIDTH; x++)
+						{
+							meshBlocks++;
+							if (chunkData->GetBlock(x, y, z) == 0)
+								continue;
+							faces += x == 0 || chunkData->GetBlock(x - 1, y, z) == 0;
+							faces += x == CHUNK_WIDTH - 1 || chunkData->GetBlock(x + 1, y, z) == 0;
+							faces += y == 0 || chunkData->GetBlock(x, y - 1, z) == 0;
+							faces += chunkData->GetBlock(x, y + 1, z) == 0;
+							faces += z == 0 || chunkData->GetBlock(x, y, z - 1) == 0;
+							faces += z == CHUNK_WIDTH - 1 || chunkData->GetBlock(x, y, z + 1) == 0;
+						}
+					}
+				}
+			}
+			sink = sink + faces;
+		});
+
+		// The padded copy the mesher reads from now
+		int paddedBlocks = 0;
+		std::vector<uint16_t> padded;
+		ChunkBorders noBorders;
+		double paddedMs = TimeMs([&]() {
+			for (auto& chunkData : chunks)
+			{
+				int height = chunkData->GetMaxHeight();
+				padded.resize((height + 3) * PADDED_CHUNK_WIDTH * PADDED_CHUNK_WIDTH);
+				chunkData->CopyPadded(0, height + 1, padded.data(), noBorders);
+				paddedBlocks += (height + 1) * CHUNK_WIDTH * CHUNK_WIDTH;
+			}
+		});
+
+		// Rays from random points in random directions, stepping until they hit a block or leave the chunk
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+		int raySteps = 0;
+		double rayMs = TimeMs([&]() {
+			uint32_t hits = 0;
+			for (int ray = 0; ray < BENCHMARK_RAYS; ray++)
+			{
+				ChunkData& chunkData = *chunks[ray % chunks.size()];
+				float x = unit(rng) * CHUNK_WIDTH, y = unit(rng) * BENCHMARK_HEIGHT, z = unit(rng) * CHUNK_WIDTH;
+				float dx = direction(rng) * 0.5f, dy = direction(rng) * 0.5f, dz = direction(rng) * 0.5f;
+				for (int step = 0; step < 256; step++, raySteps++)
+				{
+					if (x < 0 || x >= CHUNK_WIDTH || y < 0 || y >= CHUNK_HEIGHT || z < 0 || z >= CHUNK_WIDTH)
+						break;
+					if (chunkData.GetBlock((int)x, (int)y, (int)z) != 0)
+					{
+						hits++;
+						break;
+					}
+					x += dx;
+					y += dy;
+					z += dz;
+				}
+			}
+			sink = sink + hits;
+		});
+
+		PrintResult("Generation (per chunk)", generationMs, (int)chunks.size());
+		PrintResult("Neighbour reads (per block)", meshMs, meshBlocks);
+		PrintResult("Padded copy (per block)", paddedMs, paddedBlocks);
+		PrintResult("Raycast (per step)", rayMs, raySteps);
+	}
+
+	// Compress and decompress each chunk repeatedly, as happens when chunks move in and out of range.
+	void CompressionRoundTrip(std::vector<std::unique_ptr<ChunkData>>& chunks)
+	{
+		ZoneScoped;
+		fmt::printf("Compression round trip (%i chunks, %i passes)\n", (int)chunks.size(), BENCHMARK_ROUND_TRIPS);
+
+		volatile size_t sink = 0;
+
+		// Per-block run detection through GetBlock, how Compress used to walk a section
+		double referenceMs = TimeMs([&]() {
+			for (int pass = 0; pass < BENCHMARK_ROUND_TRIPS; pass++)
+			{
+				for (auto& chunkData : chunks)
+				{
+					std::vector<CompressedBlockID> runs;
+					uint16_t blockId = chunkData->GetBlock(0);
+					for (int i = 1; i < CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_WIDTH; i++)
+					{
+						uint16_t nextBlockId = chunkData->GetBlock(i);
+						if (nextBlockId != blockId || i % CHUNK_SECTION_BLOCKS == 0)
+						{
+							runs.push_back({ (uint16_t)(i % CHUNK_SECTION_BLOCKS), blockId });
+							blockId = nextBlockId;
+						}
+					}
+					sink = sink + runs.size();
+				}
+			}
+		});
+
+		double compressMs = 0, decompressMs = 0;
+		for (int pass = 0; pass < BENCHMARK_ROUND_TRIPS; pass++)
+		{
+			for (auto& chunkData : chunks)
+			{
+				compressMs += TimeMs([&]() { chunkData->Compress(); });
+				decompressMs += TimeMs([&]() { chunkData->Decompress(); });
+			}
+		}
+
+		int count = (int)chunks.size() * BENCHMARK_ROUND_TRIPS;
+		PrintResult("Per-block run detection", referenceMs, count);
+		PrintResult("Compress", compressMs, count);
+		PrintResult("Decompress", decompressMs, count);
+	}
+}
+
+void Benchmark::Run()
+{
+	ZoneScoped;
+
+	std::vector<std::unique_ptr<ChunkData>> chunks;
+	double generationMs = TimeMs([&]() { chunks = GenerateChunks(); });
+	LayoutThroughput(chunks, generationMs);
+	CompressionRoundTrip(chunks);
+	CompressedAccess(chunks);
+
+	fmt::printf("Block pool: %zu KiB peak, %zu KiB reserved, %.0f%% of allocations reused\n",
+		SlabPool::Get().GetHighWaterMark() / 1024, SlabPool::Get().GetBytesReserved() / 1024, SlabPool::Get().GetReuseRate() * 100.0);
+}
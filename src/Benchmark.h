@@ -0,0 +1,8 @@
+#pragma once
+
+// Offline measurements of the chunk data structures, run with --benchmark.
+// Only touches ChunkData and WorldGen, so no window or GL context is needed.
+namespace Benchmark
+{
+	void Run();
+}
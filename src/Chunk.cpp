@@ -1,7 +1,10 @@
 #include "Chunk.h"
 
-#include <bitset>
+#include <algorithm>
+#include <bit>
 #include <iostream>
+#include <numeric>
+#include <utility>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <fmt/printf.h>
@@ -9,726 +12,772 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <tracy/Tracy.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 #include "Planet.h"
 #include "Blocks.h"
 #include "WorldGen.h"
 
-Chunk::Chunk(ChunkPos chunkPos, Shader* shader, Shader* waterShader)
-	: chunkPos(chunkPos)
+// Face directions, the same numbering as the shaders' normals and PackedQuad's face.
+// FACE_UNDERSIDE is the underside of a liquid's top, which is only ever a quad.
+enum { FACE_NORTH, FACE_SOUTH, FACE_WEST, FACE_EAST, FACE_BOTTOM, FACE_TOP, FACE_UNDERSIDE, FACE_BILLBOARD };
+
+enum FaceTile { TILE_SIDE, TILE_BOTTOM, TILE_TOP };
+
+// Per direction, the axes (0 = x, 1 = y, 2 = z) a quad's width and height run along and which of the block's
+// tiles it shows. Greedy meshing grows quads along these axes and the vertex shaders stretch the corners
+// along the same ones, the shaders also hold the corner offsets and normals for each direction.
+struct FaceInfo
 {
-	worldPos = glm::vec3(chunkPos.x * (float)CHUNK_WIDTH, chunkPos.y * (float)CHUNK_HEIGHT, chunkPos.z * (float)CHUNK_WIDTH);
+	int widthAxis, heightAxis;
+	FaceTile tile;
+};
+
+static constexpr FaceInfo faceTable[6] = {
+	{ 0, 1, TILE_SIDE },   // North
+	{ 0, 1, TILE_SIDE },   // South
+	{ 2, 1, TILE_SIDE },   // West
+	{ 2, 1, TILE_SIDE },   // East
+	{ 0, 2, TILE_BOTTOM }, // Bottom
+	{ 0, 2, TILE_TOP },    // Top
+};
+using FaceSequence = std::make_integer_sequence<int, 6>;
+
+// The neighbour each direction's faces look at
+static const glm::ivec3 faceOffsets[6] = {
+	{ 0, 0, -1 }, { 0, 0, 1 }, { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 },
+};
+
+// Free slots left at the end of each direction's range in meshes that can be patched, so edits can add faces
+constexpr int PATCH_SLACK = 8;
+
+// Where a mesh job writes its quads. The buffers behind these are sized for the job before anything is
+// written, so emitting is a plain store and a pointer bump. Opaque quads get a range per direction.
+struct MeshOutput
+{
+	PackedQuad* main[6];
+	PackedQuad* water;
+	PackedBillboard* billboards;
+};
 
-	ready = false;
-	generated = false;
-	markedForDelete = false;
-	edgeUpdate = false;
+// Per thread buffers mesh jobs write into before the result is copied out to the section or border strip
+struct MeshArena
+{
+	std::vector<PackedQuad> mainQuads;
+	std::vector<PackedQuad> waterQuads;
+	std::vector<PackedBillboard> billboards;
+	// Greedy meshing's recorded faces, merging clears every entry again so it's all zero between jobs
+	std::vector<uint16_t> faceKeys;
+
+	// Makes room for count elements and returns where they start
+	template<typename T>
+	static T* Reserve(std::vector<T>& buffer, size_t count)
+	{
+		if (buffer.size() < count)
+			buffer.resize(std::max(count, buffer.size() * 2));
+		return buffer.data();
+	}
+};
+static thread_local MeshArena meshArena;
+
+// Greedy meshing records the visible faces per direction and block before merging them, each direction
+// gets a section's worth of keys
+constexpr size_t faceKeyStride = CHUNK_SECTION_BLOCKS;
+
+// Which ways a block shows up in the face masks, by block id
+enum { MASK_SOLID, MASK_LIQUID, MASK_OPAQUE, MASK_BILLBOARD, MASK_COUNT };
+static const std::vector<uint8_t>& GetBlockMasks()
+{
+	static const std::vector<uint8_t> blockMasks = []
+	{
+		std::vector<uint8_t> masks(Blocks::blocks.size());
+		for (size_t i = 1; i < Blocks::blocks.size(); i++)
+		{
+			switch (Blocks::blocks[i].blockType)
+			{
+			case Block::SOLID: masks[i] = 1 << MASK_SOLID | 1 << MASK_OPAQUE; break;
+			case Block::LIQUID: masks[i] = 1 << MASK_LIQUID; break;
+			case Block::BILLBOARD: masks[i] = 1 << MASK_BILLBOARD; break;
+			default: masks[i] = 1 << MASK_OPAQUE; break;
+			}
+		}
+		return masks;
+	}();
+	return blockMasks;
 }
 
-Chunk::~Chunk()
+template<int Face>
+__forceinline static glm::i8vec2 GetFaceTile(const Block& block)
 {
-	ZoneScoped;
-	Planet::planet->opaqueDrawingData.vbo.RemoveData(opaqueTri);
-	Planet::planet->opaqueDrawingData.ebo.RemoveData(opaqueEle);
-	Planet::planet->billboardDrawingData.vbo.RemoveData(billboardTri);
-	Planet::planet->billboardDrawingData.ebo.RemoveData(billboardEle);
-	Planet::planet->transparentDrawingData.vbo.RemoveData(waterTri);
-	Planet::planet->transparentDrawingData.ebo.RemoveData(waterEle);
+	if constexpr (faceTable[Face].tile == TILE_TOP)
+		return { block.topMinX, block.topMinY };
+	else if constexpr (faceTable[Face].tile == TILE_BOTTOM)
+		return { block.bottomMinX, block.bottomMinY };
+	else
+		return { block.sideMinX, block.sideMinY };
 }
 
-void Chunk::GenerateChunkMesh(Chunk::Ptr left, Chunk::Ptr right, Chunk::Ptr front, Chunk::Ptr back)
+static glm::i8vec2 GetFaceTile(const Block& block, int face)
 {
-	generated = false;
-	ZoneScoped;
-	ZoneNameF("Chunk::GenerateChunkMesh %i %i %i", chunkPos.x, chunkPos.y, chunkPos.z);
+	switch (faceTable[face].tile)
+	{
+	case TILE_TOP: return { block.topMinX, block.topMinY };
+	case TILE_BOTTOM: return { block.bottomMinX, block.bottomMinY };
+	default: return { block.sideMinX, block.sideMinY };
+	}
+}
+
+// Liquid tops are seen from below too, so they get a quad for the underside as well
+template<int Face, bool Liquid>
+__forceinline static void EmitQuad(MeshOutput& out, int x, int y, int z, int width, int height, glm::i8vec2 tile)
+{
+	PackedQuad*& quads = Liquid ? out.water : out.main[Face];
+	*quads++ = PackedQuad(x, y, z, Face, width, height, tile);
+	if constexpr (Liquid && Face == FACE_TOP)
+		*quads++ = PackedQuad(x, y, z, FACE_UNDERSIDE, width, height, tile);
+}
 
-	bool leftGenerated = left && left->chunkData.generated;
-	bool rightGenerated = right && right->chunkData.generated;
-	bool frontGenerated = front && front->chunkData.generated;
-	bool backGenerated = back && back->chunkData.generated;
+// Without greedy meshing every visible face of a block is a quad of its own
+template<int... Faces>
+__forceinline static void EmitFaces(std::integer_sequence<int, Faces...>, MeshOutput& out, uint8_t faces, const Block& block, bool liquid,
+	int x, int y, int z)
+{
+	auto Emit = [&]<int Face>()
+	{
+		if (!(faces & 1 << Face))
+			return;
+		if (liquid)
+			EmitQuad<Face, true>(out, x, y, z, 1, 1, GetFaceTile<Face>(block));
+		else
+			EmitQuad<Face, false>(out, x, y, z, 1, 1, GetFaceTile<Face>(block));
+	};
+	(Emit.template operator()<Faces>(), ...);
+}
 
-	mainVertices.clear();
-	mainIndices.clear();
-	waterVertices.clear();
-	waterIndices.clear();
-	billboardVertices.clear();
-	billboardIndices.clear();
+// With greedy meshing the faces are keyed by 1 + the face's tile and whether it's liquid, so faces that can
+// share a quad have the same key
+template<int... Faces>
+__forceinline static void RecordFaces(std::integer_sequence<int, Faces...>, uint16_t* keys, uint8_t faces, const Block& block, bool liquid,
+	int index)
+{
+	auto Record = [&]<int Face>()
+	{
+		if (!(faces & 1 << Face))
+			return;
+		glm::i8vec2 tile = GetFaceTile<Face>(block);
+		keys[Face * faceKeyStride + index] = 1 + (tile.x | tile.y << 7 | liquid << 14);
+	};
+	(Record.template operator()<Faces>(), ...);
+}
 
-	if (false)
+// Merges one direction's recorded faces into quads and clears their keys. Quads grow along the width first,
+// then add rows for as long as the whole width matches. They stay within CHUNK_WIDTH blocks each way so
+// their size fits in PackedQuad. Only the slices from firstSlice up to endSlice are looked at.
+template<int Direction>
+static void MergeDirection(uint16_t* keys, int layers, int minY, MeshOutput& out, int firstSlice = 0, int endSlice = CHUNK_WIDTH)
+{
+	constexpr FaceInfo face = faceTable[Direction];
+	constexpr int sliceAxis = 3 - face.widthAxis - face.heightAxis;
+	constexpr int strides[3] = { 1, CHUNK_WIDTH * CHUNK_WIDTH, CHUNK_WIDTH };
+	constexpr int widthStride = strides[face.widthAxis], heightStride = strides[face.heightAxis];
+	const int extents[3] = { CHUNK_WIDTH, layers, CHUNK_WIDTH };
+
+	keys += Direction * faceKeyStride;
+	endSlice = std::min(endSlice, extents[sliceAxis]);
+	for (int slice = firstSlice; slice < endSlice; slice++)
 	{
-		enum
-		{
-			FRONT = 0,
-			BACK,
-			LEFT,
-			RIGHT,
-			TOP,
-			BOTTOM
-		};
-		auto* exposedFaces = new std::bitset<CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_WIDTH * 6>;
-		for (int x = 0; x < CHUNK_WIDTH; x++)
+		uint16_t* sliceKeys = keys + slice * strides[sliceAxis];
+		for (int v = 0; v < extents[face.heightAxis]; v++)
 		{
-			for (int z = 0; z < CHUNK_WIDTH; z++)
+			for (int u = 0; u < extents[face.widthAxis]; u++)
 			{
-				for (int y = 0; y < CHUNK_HEIGHT; y++)
+				uint16_t* start = sliceKeys + u * widthStride + v * heightStride;
+				uint16_t key = *start;
+				if (!key)
+					continue;
+
+				int width = 1;
+				while (u + width < extents[face.widthAxis] && width < CHUNK_WIDTH && start[width * widthStride] == key)
+					width++;
+				int height = 1;
+				for (; v + height < extents[face.heightAxis] && height < CHUNK_WIDTH; height++)
 				{
-					int index = ChunkData::GetIndex(x, y, z);
-
-					if (chunkData.GetBlock(index) == Blocks::AIR)
-					{
-						exposedFaces->reset(index * 6 + FRONT);
-						exposedFaces->reset(index * 6 + BACK);
-						exposedFaces->reset(index * 6 + LEFT);
-						exposedFaces->reset(index * 6 + RIGHT);
-						exposedFaces->reset(index * 6 + TOP);
-						exposedFaces->reset(index * 6 + BOTTOM);
-
-						continue;
-					}
-
-					exposedFaces->set(index * 6 + FRONT);
-					exposedFaces->set(index * 6 + BACK);
-					exposedFaces->set(index * 6 + LEFT);
-					exposedFaces->set(index * 6 + RIGHT);
-					exposedFaces->set(index * 6 + TOP);
-					exposedFaces->set(index * 6 + BOTTOM);
-
-					if (z == CHUNK_WIDTH - 1 || chunkData.GetBlock(x, y, z + 1) != Blocks::AIR)
-						exposedFaces->reset(index * 6 + FRONT);
-					if (z == 0 || chunkData.GetBlock(x, y, z - 1) != Blocks::AIR)
-						exposedFaces->reset(index * 6 + BACK);
-					if (x == 0 || chunkData.GetBlock(x - 1, y, z) != Blocks::AIR)
-						exposedFaces->reset(index * 6 + LEFT);
-					if (x == CHUNK_WIDTH - 1 || chunkData.GetBlock(x + 1, y, z) != Blocks::AIR)
-						exposedFaces->reset(index * 6 + RIGHT);
-					if (y == CHUNK_HEIGHT - 1 || chunkData.GetBlock(x, y + 1, z) != Blocks::AIR)
-						exposedFaces->reset(index * 6 + TOP);
-					if (y == 0 || chunkData.GetBlock(x, y - 1, z) != Blocks::AIR)
-						exposedFaces->reset(index * 6 + BOTTOM);
+					uint16_t* row = start + height * heightStride;
+					int i = 0;
+					while (i < width && row[i * widthStride] == key)
+						i++;
+					if (i < width)
+						break;
 				}
+
+				for (int j = 0; j < height; j++)
+					for (int i = 0; i < width; i++)
+						start[i * widthStride + j * heightStride] = 0;
+
+				glm::ivec3 pos;
+				pos[sliceAxis] = slice;
+				pos[face.widthAxis] = u;
+				pos[face.heightAxis] = v;
+				pos.y += minY;
+				key--;
+				glm::i8vec2 tile = { key & 127, (key >> 7) & 127 };
+				if (key >> 14)
+					EmitQuad<Direction, true>(out, pos.x, pos.y, pos.z, width, height, tile);
+				else
+					EmitQuad<Direction, false>(out, pos.x, pos.y, pos.z, width, height, tile);
 			}
 		}
+	}
+}
+
+template<int... Directions>
+static void MergeFaces(std::integer_sequence<int, Directions...>, uint16_t* keys, int layers, int minY, MeshOutput& out)
+{
+	(MergeDirection<Directions>(keys, layers, minY, out), ...);
+}
 
-		mainVertices.reserve(5000);
-		mainIndices.reserve(5000);
-		waterVertices.reserve(5000);
-		waterIndices.reserve(5000);
-		billboardVertices.reserve(5000);
-		billboardIndices.reserve(5000);
+static void DecodeQuad(const PackedQuad& quad, glm::ivec3& pos, int& width, int& height)
+{
+	pos = { quad.position & 31, quad.position >> 5 & 511, quad.position >> 14 & 31 };
+	width = (quad.position >> 22 & 31) + 1;
+	height = (quad.position >> 27 & 31) + 1;
+}
+
+// Whether the quad has the face of the given direction at cell
+static bool QuadCovers(const PackedQuad& quad, int face, const glm::ivec3& cell)
+{
+	if ((int)(quad.position >> 19 & 7) != face)
+		return false;
+	glm::ivec3 pos;
+	int width, height;
+	DecodeQuad(quad, pos, width, height);
+	const FaceInfo& info = faceTable[face];
+	int sliceAxis = 3 - info.widthAxis - info.heightAxis;
+	return pos[sliceAxis] == cell[sliceAxis]
+		&& cell[info.widthAxis] >= pos[info.widthAxis] && cell[info.widthAxis] < pos[info.widthAxis] + width
+		&& cell[info.heightAxis] >= pos[info.heightAxis] && cell[info.heightAxis] < pos[info.heightAxis] + height;
+}
 
-		uint32_t currentVertex = 0;
+// The quads left of a quad once its face at cell is taken out, at most four: the rows before and after the
+// cell's and the parts of its row either side of it. Returns how many there are.
+static int CutQuad(const PackedQuad& quad, const glm::ivec3& cell, PackedQuad (&pieces)[4])
+{
+	int face = quad.position >> 19 & 7;
+	glm::ivec3 pos;
+	int width, height;
+	DecodeQuad(quad, pos, width, height);
+	const FaceInfo& info = faceTable[face];
+	int u = cell[info.widthAxis] - pos[info.widthAxis], v = cell[info.heightAxis] - pos[info.heightAxis];
+
+	int count = 0;
+	auto Piece = [&](int offsetU, int offsetV, int pieceWidth, int pieceHeight)
+	{
+		if (pieceWidth <= 0 || pieceHeight <= 0)
+			return;
+		glm::ivec3 start = pos;
+		start[info.widthAxis] += offsetU;
+		start[info.heightAxis] += offsetV;
+		pieces[count] = PackedQuad(start.x, start.y, start.z, face, pieceWidth, pieceHeight, { 0, 0 });
+		pieces[count++].texture = quad.texture;
+	};
+	Piece(0, 0, width, v);
+	Piece(0, v + 1, width, height - v - 1);
+	Piece(0, v, u, 1);
+	Piece(u + 1, v, width - u - 1, 1);
+	return count;
+}
 
-		uint16_t* blockIDs = new uint16_t[CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_WIDTH];
-		memcpy(blockIDs, chunkData.blockIDs, sizeof(blockIDs));
+// A billboard block is one record, the shader builds its crossed quads
+__forceinline static void EmitBillboard(MeshOutput& out, int x, int y, int z, const Block& block)
+{
+	*out.billboards++ = PackedBillboard(x, y, z, { block.sideMinX, block.sideMinY });
+}
 
-		glm::ivec3 start = {-1,-1,-1};
-		uint16_t startBlockID = -1;
+// Meshes a border strip's faces, the ones of the chunk's side plane towards the neighbour. Both the plane's
+// blocks and the neighbour's edge are given as [y * CHUNK_WIDTH + i] with i along the side, outside is null
+// without a neighbour. Greedy meshing merges the faces a section's height at a time, like the sections do.
+template<int Face>
+static void MeshBorderFaces(const uint16_t* inside, const uint16_t* outside, int height, int plane, bool greedy, MeshOutput& out)
+{
+	constexpr bool alongZ = faceTable[Face].widthAxis == 2; // Whether the plane is at a fixed x
+	constexpr int layerSize = CHUNK_WIDTH * CHUNK_WIDTH;
+	const std::vector<uint8_t>& blockMasks = GetBlockMasks();
 
-		for (int y = 0; y < CHUNK_HEIGHT; y++)
+	for (int minY = 0; minY < height; minY += CHUNK_SECTION_HEIGHT)
+	{
+		int layers = std::min(height - minY, (int)CHUNK_SECTION_HEIGHT);
+		bool recorded = false;
+		for (int y = minY; y < minY + layers; y++)
 		{
-			for (int x = 0; x < CHUNK_WIDTH; x++)
+			for (int i = 0; i < CHUNK_WIDTH; i++)
 			{
-				for (int z = 0; z < CHUNK_WIDTH; z++)
+				uint16_t id = inside[y * CHUNK_WIDTH + i];
+				uint8_t mask = blockMasks[id];
+				uint8_t neighbour = outside ? blockMasks[outside[y * CHUNK_WIDTH + i]] : 0;
+				bool liquid = mask >> MASK_LIQUID & 1;
+				if (neighbour >> MASK_SOLID & 1 || !(mask >> MASK_OPAQUE & 1 || (liquid && !(neighbour >> MASK_LIQUID & 1))))
+					continue;
+
+				int x = alongZ ? plane : i, z = alongZ ? i : plane;
+				if (greedy)
 				{
-					int index = ChunkData::GetIndex(x, y, z);
+					RecordFaces(std::integer_sequence<int, Face>(), meshArena.faceKeys.data(), 1 << Face, Blocks::blocks[id], liquid,
+						(y - minY) * layerSize + z * CHUNK_WIDTH + x);
+					recorded = true;
+				}
+				else
+				{
+					EmitFaces(std::integer_sequence<int, Face>(), out, 1 << Face, Blocks::blocks[id], liquid, x, y, z);
+				}
+			}
+		}
 
-					if (start.x == -1)
-					{
-						start = { x, y, z };
-						startBlockID = blockIDs[index];
-					}
+		if (recorded)
+			MergeDirection<Face>(meshArena.faceKeys.data(), layers, minY, out, plane, plane + 1);
+	}
+}
 
-					if (blockIDs[index] != startBlockID)
-					{
+Chunk::Chunk(ChunkPos chunkPos, Shader* shader, Shader* waterShader)
+	: chunkPos(chunkPos)
+{
+	worldPos = glm::vec3(chunkPos.x * (float)CHUNK_WIDTH, chunkPos.y * (float)CHUNK_HEIGHT, chunkPos.z * (float)CHUNK_WIDTH);
 
-					}
-				}
-			}
+	ready = false;
+	generated = false;
+	markedForDelete = false;
+	edgeSides = 0;
+}
+
+Chunk::~Chunk()
+{
+	ZoneScoped;
+	for (SectionMesh& mesh : sectionMeshes)
+	{
+		Planet::planet->opaqueQuadData.quads.RemoveData(mesh.opaqueMesh);
+		Planet::planet->billboardQuadData.quads.RemoveData(mesh.billboardMesh);
+		Planet::planet->transparentQuadData.quads.RemoveData(mesh.waterMesh);
+	}
+	for (BorderMesh& mesh : borderMeshes)
+	{
+		Planet::planet->opaqueQuadData.quads.RemoveData(mesh.opaqueMesh);
+		Planet::planet->transparentQuadData.quads.RemoveData(mesh.waterMesh);
+	}
+}
+
+void Chunk::GenerateChunkMesh(const ChunkData& data, const ChunkData* left, const ChunkData* right, const ChunkData* front, const ChunkData* back, uint32_t meshes)
+{
+	generated = false;
+	ZoneScoped;
+	ZoneNameF("Chunk::GenerateChunkMesh %i %i %i", chunkPos.x, chunkPos.y, chunkPos.z);
+
+	int maxHeight = data.GetMaxHeight();
+
+	// Everything below the lowest block that isn't solid is solid all the way through and only has faces on
+	// the bottom layer. Faces towards the neighbours are in the border strips, so their blocks don't matter here.
+	int lowestExposed = maxHeight + 1;
+	for (int x = 0; x < CHUNK_WIDTH; x++)
+		for (int z = 0; z < CHUNK_WIDTH; z++)
+			lowestExposed = std::min(lowestExposed, data.GetLowestExposed(x, z));
+	int firstLayer = std::max(lowestExposed - 1, 1); // First layer above the bottom one with faces
+
+	// The neighbours are only read here, the border strips below mesh against these copies of their edges.
+	// Only the sides being meshed are copied. The copy belongs to this job, the other threads' subtasks read
+	// it while this one waits in RunParallel.
+	ChunkBorders borders;
+	uint32_t borderMask = meshes >> CHUNK_SECTION_COUNT;
+	if (borderMask)
+	{
+		borders.Extract(maxHeight + 1, borderMask & 1 ? left : nullptr, borderMask & 2 ? right : nullptr,
+			borderMask & 4 ? front : nullptr, borderMask & 8 ? back : nullptr);
+	}
+
+	// Sections first, then the border strips as CHUNK_SECTION_COUNT + side
+	int toMesh[CHUNK_SECTION_COUNT + 4];
+	int toMeshCount = 0;
+	bool uniformSections[CHUNK_SECTION_COUNT] = {};
+	for (int section = 0; section < CHUNK_SECTION_COUNT; section++)
+	{
+		if (!(meshes >> section & 1))
+			continue;
+
+		// Sections above the highest block, buried below the lowest exposed one or all air stay empty
+		int minY = section * CHUNK_SECTION_HEIGHT;
+		int maxY = std::min(minY + (int)CHUNK_SECTION_HEIGHT, maxHeight + 1);
+		uint16_t uniformBlock = Blocks::AIR;
+		bool uniform = data.IsSectionUniform(section, uniformBlock);
+		if (minY >= maxY || (minY > 0 && maxY <= firstLayer) || (uniform && uniformBlock == Blocks::AIR))
+		{
+			std::lock_guard lock(meshMutex);
+			SectionMesh& mesh = sectionMeshes[section];
+			mesh.mainQuads.clear();
+			mesh.mainDirectionQuads = {};
+			mesh.waterQuads.clear();
+			mesh.billboards.clear();
+			MarkMeshed(1u << section);
+			continue;
 		}
 
-		for (int x = 0; x < CHUNK_WIDTH; x++)
+		// A section of one solid or liquid block only has faces on its top and bottom layers
+		Block::BLOCK_TYPE type = Blocks::blocks[uniformBlock].blockType;
+		uniformSections[section] = uniform && (type == Block::SOLID || type == Block::LIQUID);
+		toMesh[toMeshCount++] = section;
+	}
+	for (int side = 0; side < 4; side++)
+		if (borderMask >> side & 1)
+			toMesh[toMeshCount++] = CHUNK_SECTION_COUNT + side;
+
+	// Sections and strips mesh independently of each other, so they're spread over the generator threads
+	Planet::planet->RunParallel(toMeshCount, [&](int i)
+	{
+		if (toMesh[i] >= CHUNK_SECTION_COUNT)
 		{
-			for (int z = 0; z < CHUNK_WIDTH; z++)
-			{
-				for (int y = 0; y < CHUNK_HEIGHT; y++)
-				{
-					int index = ChunkData::GetIndex(x, y, z);
-					uint16_t blockID = chunkData.GetBlock(index);
+			GenerateBorderMesh(data, borders, toMesh[i] - CHUNK_SECTION_COUNT, borderMeshes[toMesh[i] - CHUNK_SECTION_COUNT]);
+			return;
+		}
+		int minY = toMesh[i] * CHUNK_SECTION_HEIGHT;
+		int maxY = std::min(minY + (int)CHUNK_SECTION_HEIGHT, maxHeight + 1);
+		GenerateSectionMesh(data, minY, maxY, firstLayer, uniformSections[toMesh[i]], sectionMeshes[toMesh[i]]);
+	});
 
-					if (start.x == -1)
-					{
-						start = { x, y, z };
-						startBlockID = blockID;
-					}
+	//std::cout << "Finished generating in thread: " << std::this_thread::get_id() << '\n';
 
-					if (blockID != startBlockID)
-						goto new_face;
+	//std::cout << "Generated: " << generated << '\n';
+	generated = true;
+}
 
+void Chunk::GenerateSectionMesh(const ChunkData& data, int minY, int maxY, int firstLayer, bool uniform, SectionMesh& mesh)
+{
+	ZoneScoped;
 
+	// Layers are numbered from minY below, the quads get minY added back when they're made. A uniform section's
+	// layers between its top and bottom ones are treated as buried.
+	int layers = maxY - minY;
+	uniform &= layers > 2;
+	auto Buried = [&](int layer)
+	{
+		return (minY + layer > 0 && minY + layer < firstLayer) || (uniform && layer > 0 && layer < layers - 1);
+	};
+
+	// Copy the section out once, with the layers above and below it, so the loops below read a flat array
+	// rather than going through the chunk data per block. The faces towards the neighbours are left to the
+	// border strips, so the padding around the sides stays air.
+	static thread_local std::vector<uint16_t> paddedBlocks;
+	static const ChunkBorders noBorders;
+	constexpr int paddedLayerSize = PADDED_CHUNK_WIDTH * PADDED_CHUNK_WIDTH;
+	paddedBlocks.resize((layers + 2) * paddedLayerSize);
+	if (uniform)
+	{
+		// Only the top and bottom layers and those either side of them are read, the rest is left as it was
+		data.CopyPadded(minY, minY + 1, paddedBlocks.data(), noBorders);
+		data.CopyPadded(maxY - 1, maxY, paddedBlocks.data() + (layers - 1) * paddedLayerSize, noBorders);
+	}
+	else
+	{
+		data.CopyPadded(minY, maxY, paddedBlocks.data(), noBorders);
+	}
+	auto BlockAt = [&](int x, int y, int z) -> uint16_t
+	{
+		return paddedBlocks[(y + 1) * paddedLayerSize + (z + 1) * PADDED_CHUNK_WIDTH + (x + 1)];
+	};
+
+	// With greedy meshing the faces are recorded into faceKeys first and merged into quads afterwards
+	bool greedy = Planet::planet->greedyMeshing;
+	std::vector<uint16_t>& faceKeys = meshArena.faceKeys;
+	if (greedy && faceKeys.size() < faceKeyStride * 6)
+		faceKeys.resize(faceKeyStride * 6);
+
+	// Work out which faces are visible a row of blocks at a time. Each padded row along x gets bit masks
+	// of its solid, liquid, opaque (meshed into the main stream) and billboard blocks, then a face is
+	// visible where a block's mask meets the neighbouring row's masks, shifted by one along x for west
+	// and east. Opaque faces show next to anything that isn't solid and liquid faces next to anything that
+	// is neither solid nor liquid, except the top of a liquid which shows unless there's liquid above it.
+	// The result is a byte per block with a bit per face direction, plus one for billboards, and a bit per
+	// layer for each column saying whether the byte has anything in it.
+	static thread_local std::vector<uint8_t> faceBits;
+	constexpr int layerSize = CHUNK_WIDTH * CHUNK_WIDTH;
+	uint32_t columnLayers[layerSize] = {};
+	static_assert(CHUNK_SECTION_HEIGHT <= 32, "columnLayers has a bit per layer");
+	size_t opaqueQuads[6] = {}, liquidQuads = 0, billboards = 0;
 
-					new_face:
+	{
+		ZoneScopedN("Face masks");
 
-					const Block& block = Blocks::blocks[startBlockID];
+		const std::vector<uint8_t>& blockMasks = GetBlockMasks();
 
-					if (exposedFaces->test(index * 6 + FRONT))
-					{
-						mainVertices.push_back({ { x + 0, y + 0, z + 1 }, { block.sideMinX, block.sideMinY}, 1 });
-						mainVertices.push_back({ { x + 1, y + 0, z + 1 }, { block.sideMaxX, block.sideMinY}, 1 });
-						mainVertices.push_back({ { x + 0, y + 1, z + 1 }, { block.sideMinX, block.sideMaxY}, 1 });
-						mainVertices.push_back({ { x + 1, y + 1, z + 1 }, { block.sideMaxX, block.sideMaxY}, 1 });
-
-						mainIndices.push_back(currentVertex + 0);
-						mainIndices.push_back(currentVertex + 3);
-						mainIndices.push_back(currentVertex + 1);
-						mainIndices.push_back(currentVertex + 0);
-						mainIndices.push_back(currentVertex + 2);
-						mainIndices.push_back(currentVertex + 3);
-						currentVertex += 4;
-					}
-					if (exposedFaces->test(index * 6 + BACK))
-					{
-						mainVertices.push_back({ { x + 1, y + 0, z + 0 }, { block.sideMinX, block.sideMinY}, 0 });
-						mainVertices.push_back({ { x + 0, y + 0, z + 0 }, { block.sideMaxX, block.sideMinY}, 0 });
-						mainVertices.push_back({ { x + 1, y + 1, z + 0 }, { block.sideMinX, block.sideMaxY}, 0 });
-						mainVertices.push_back({ { x + 0, y + 1, z + 0 }, { block.sideMaxX, block.sideMaxY}, 0 });
-
-						mainIndices.push_back(currentVertex + 0);
-						mainIndices.push_back(currentVertex + 3);
-						mainIndices.push_back(currentVertex + 1);
-						mainIndices.push_back(currentVertex + 0);
-						mainIndices.push_back(currentVertex + 2);
-						mainIndices.push_back(currentVertex + 3);
-						currentVertex += 4;
-					}
-					if (exposedFaces->test(index * 6 + LEFT))
-					{
-						mainVertices.push_back({ { x + 0, y + 0, z + 0 }, { block.sideMinX, block.sideMinY}, 2 });
-						mainVertices.push_back({ { x + 0, y + 0, z + 1 }, { block.sideMaxX, block.sideMinY}, 2 });
-						mainVertices.push_back({ { x + 0, y + 1, z + 0 }, { block.sideMinX, block.sideMaxY}, 2 });
-						mainVertices.push_back({ { x + 0, y + 1, z + 1 }, { block.sideMaxX, block.sideMaxY}, 2 });
-
-						mainIndices.push_back(currentVertex + 0);
-						mainIndices.push_back(currentVertex + 3);
-						mainIndices.push_back(currentVertex + 1);
-						mainIndices.push_back(currentVertex + 0);
-						mainIndices.push_back(currentVertex + 2);
-						mainIndices.push_back(currentVertex + 3);
-						currentVertex += 4;
-					}
-					if (exposedFaces->test(index * 6 + RIGHT))
-					{
-						mainVertices.push_back({ { x + 1, y + 0, z + 1 }, { block.sideMinX, block.sideMinY}, 3 });
-						mainVertices.push_back({ { x + 1, y + 0, z + 0 }, { block.sideMaxX, block.sideMinY}, 3 });
-						mainVertices.push_back({ { x + 1, y + 1, z + 1 }, { block.sideMinX, block.sideMaxY}, 3 });
-						mainVertices.push_back({ { x + 1, y + 1, z + 0 }, { block.sideMaxX, block.sideMaxY}, 3 });
-
-						mainIndices.push_back(currentVertex + 0);
-						mainIndices.push_back(currentVertex + 3);
-						mainIndices.push_back(currentVertex + 1);
-						mainIndices.push_back(currentVertex + 0);
-						mainIndices.push_back(currentVertex + 2);
-						mainIndices.push_back(currentVertex + 3);
-						currentVertex += 4;
-					}
-					if (exposedFaces->test(index * 6 + TOP))
-					{
-						mainVertices.push_back({ { x + 0, y + 1, z + 1 }, { block.topMinX, block.topMinY}, 5 });
-						mainVertices.push_back({ { x + 1, y + 1, z + 1 }, { block.topMaxX, block.topMinY}, 5 });
-						mainVertices.push_back({ { x + 0, y + 1, z + 0 }, { block.topMinX, block.topMaxY}, 5 });
-						mainVertices.push_back({ { x + 1, y + 1, z + 0 }, { block.topMaxX, block.topMaxY}, 5 });
-
-						mainIndices.push_back(currentVertex + 0);
-						mainIndices.push_back(currentVertex + 3);
-						mainIndices.push_back(currentVertex + 1);
-						mainIndices.push_back(currentVertex + 0);
-						mainIndices.push_back(currentVertex + 2);
-						mainIndices.push_back(currentVertex + 3);
-						currentVertex += 4;
-					}
-					if (exposedFaces->test(index * 6 + BOTTOM))
-					{
-						mainVertices.push_back({ { x + 1, y + 0, z + 1 }, { block.bottomMinX, block.bottomMinY}, 4 });
-						mainVertices.push_back({ { x + 0, y + 0, z + 1 }, { block.bottomMaxX, block.bottomMinY}, 4 });
-						mainVertices.push_back({ { x + 1, y + 0, z + 0 }, { block.bottomMinX, block.bottomMaxY}, 4 });
-						mainVertices.push_back({ { x + 0, y + 0, z + 0 }, { block.bottomMaxX, block.bottomMaxY}, 4 });
-
-						mainIndices.push_back(currentVertex + 0);
-						mainIndices.push_back(currentVertex + 3);
-						mainIndices.push_back(currentVertex + 1);
-						mainIndices.push_back(currentVertex + 0);
-						mainIndices.push_back(currentVertex + 2);
-						mainIndices.push_back(currentVertex + 3);
-						currentVertex += 4;
-					}
+		static thread_local std::vector<uint64_t> rowMasks;
+		int paddedRows = (layers + 2) * PADDED_CHUNK_WIDTH;
+		rowMasks.resize(paddedRows * MASK_COUNT);
+		for (int row = 0; row < paddedRows; row++)
+		{
+			// Skip the buried layers' rows, the layers either side of those with faces are still needed
+			int layer = row / PADDED_CHUNK_WIDTH - 1;
+			if (Buried(layer - 1) && Buried(layer) && Buried(layer + 1))
+				continue;
+
+			const uint16_t* blocks = &paddedBlocks[row * PADDED_CHUNK_WIDTH];
+
+			// Most rows are all air or all underground, those don't need a lookup per block
+			bool uniform = true;
+			for (int x = 1; x < PADDED_CHUNK_WIDTH; x++)
+				uniform &= blocks[x] == blocks[0];
+			if (uniform)
+			{
+				for (int i = 0; i < MASK_COUNT; i++)
+					rowMasks[row * MASK_COUNT + i] = blockMasks[blocks[0]] >> i & 1 ? (1ull << PADDED_CHUNK_WIDTH) - 1 : 0;
+				continue;
+			}
 
-					start = { x, y, z };
-					startBlockID = blockID;
-				}
+			alignas(16) uint8_t rowBlockMasks[48] = {};
+			for (int x = 0; x < PADDED_CHUNK_WIDTH; x++)
+				rowBlockMasks[x] = blockMasks[blocks[x]];
+
+			uint64_t masks[MASK_COUNT] = {};
+#if defined(__SSE2__) || defined(_M_X64)
+			// Shift each mask bit up to the top of its byte and let movemask gather 16 of them at once
+			for (int x = 0; x < PADDED_CHUNK_WIDTH; x += 16)
+			{
+				__m128i lanes = _mm_load_si128((const __m128i*)(rowBlockMasks + x));
+				for (int i = 0; i < MASK_COUNT; i++)
+					masks[i] |= (uint64_t)_mm_movemask_epi8(_mm_slli_epi16(lanes, 7 - i)) << x;
 			}
+#else
+			for (int x = 0; x < PADDED_CHUNK_WIDTH; x++)
+				for (int i = 0; i < MASK_COUNT; i++)
+					masks[i] |= (uint64_t)(rowBlockMasks[x] >> i & 1) << x;
+#endif
+			for (int i = 0; i < MASK_COUNT; i++)
+				rowMasks[row * MASK_COUNT + i] = masks[i];
 		}
 
-		delete[] blockIDs;
-		delete exposedFaces;
-	}
-	else if (true)
-	{
-		//mainVertices.reserve(CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_WIDTH * 4 * 6);
-		//mainIndices.reserve(CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_WIDTH * 6 * 6);
-		//waterVertices.reserve(CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_WIDTH * 4 * 6);
-		//waterIndices.reserve(CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_WIDTH * 6 * 6);
-		//billboardVertices.reserve(CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_WIDTH * 4 * 6);
-		//billboardIndices.reserve(CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_WIDTH * 6 * 6);
-
-		uint32_t currentVertex = 0;
-		uint32_t currentLiquidVertex = 0;
-		uint32_t currentBillboardVertex = 0;
-		for (int x = 0; x < CHUNK_WIDTH; x++)
+		// The meshing loop clears each byte it reads, so faceBits is all zero again afterwards
+		if (faceBits.size() < CHUNK_SECTION_BLOCKS)
+			faceBits.resize(CHUNK_SECTION_BLOCKS);
+		constexpr uint64_t INSIDE = ((1ull << CHUNK_WIDTH) - 1) << 1; // Drops the neighbours' blocks at either end
+		auto Row = [&](int y, int z) { return &rowMasks[((y + 1) * PADDED_CHUNK_WIDTH + z + 1) * MASK_COUNT]; };
+		for (int y = 0; y < layers; y++)
 		{
+			if (Buried(y))
+				continue;
+
 			for (int z = 0; z < CHUNK_WIDTH; z++)
 			{
-				for (int y = 0; y < CHUNK_HEIGHT; y++)
+				const uint64_t* row = Row(y, z);
+				uint64_t opaque = row[MASK_OPAQUE] & INSIDE;
+				uint64_t liquid = row[MASK_LIQUID] & INSIDE;
+				uint64_t billboard = row[MASK_BILLBOARD] & INSIDE;
+				if (!(opaque | liquid | billboard))
+					continue;
+
+				auto Exposed = [&](uint64_t solid, uint64_t liquidNeighbour)
 				{
-					if (chunkData.GetBlock(x, y, z) == Blocks::AIR)
-						continue;
-
-					const Block* block = &Blocks::blocks[chunkData.GetBlock(x, y, z)];
-
-					if (block->blockType == Block::BILLBOARD)
+					return (opaque & ~solid) | (liquid & ~solid & ~liquidNeighbour);
+				};
+				const uint64_t* north = Row(y, z - 1);
+				const uint64_t* south = Row(y, z + 1);
+				const uint64_t* bottom = Row(y - 1, z);
+				const uint64_t* top = Row(y + 1, z);
+				uint64_t faces[FACE_TOP + 1] = {
+					Exposed(north[MASK_SOLID], north[MASK_LIQUID]),
+					Exposed(south[MASK_SOLID], south[MASK_LIQUID]),
+					Exposed(row[MASK_SOLID] << 1, row[MASK_LIQUID] << 1),
+					Exposed(row[MASK_SOLID] >> 1, row[MASK_LIQUID] >> 1),
+					Exposed(bottom[MASK_SOLID], bottom[MASK_LIQUID]),
+					(opaque & ~top[MASK_SOLID]) | (liquid & ~top[MASK_LIQUID]),
+				};
+				// Faces looking out of the chunk belong to the border strips
+				faces[FACE_WEST] &= ~(1ull << 1);
+				faces[FACE_EAST] &= ~(1ull << CHUNK_WIDTH);
+				if (z == 0)
+					faces[FACE_NORTH] = 0;
+				if (z == CHUNK_WIDTH - 1)
+					faces[FACE_SOUTH] = 0;
+
+				// Rows are usually sparse, so go over the set bits rather than every block
+				uint8_t* out = &faceBits[y * layerSize + z * CHUNK_WIDTH];
+				for (int i = 0; i <= FACE_TOP; i++)
+				{
+					for (uint64_t face = faces[i]; face; face &= face - 1)
 					{
-						billboardVertices.push_back({ { x + .85355f, y + 0, z + .85355f }, { block->sideMinX, block->sideMinY } });
-						billboardVertices.push_back({ { x + .14645f, y + 0, z + .14645f }, { block->sideMaxX, block->sideMinY } });
-						billboardVertices.push_back({ { x + .85355f, y + 1, z + .85355f }, { block->sideMinX, block->sideMaxY } });
-						billboardVertices.push_back({ { x + .14645f, y + 1, z + .14645f }, { block->sideMaxX, block->sideMaxY } });
-
-						billboardIndices.push_back(currentBillboardVertex + 0);
-						billboardIndices.push_back(currentBillboardVertex + 3);
-						billboardIndices.push_back(currentBillboardVertex + 1);
-						billboardIndices.push_back(currentBillboardVertex + 0);
-						billboardIndices.push_back(currentBillboardVertex + 2);
-						billboardIndices.push_back(currentBillboardVertex + 3);
-						currentBillboardVertex += 4;
-
-						billboardVertices.push_back({ { x + .14645f, y + 0, z + .85355f }, { block->sideMinX, block->sideMinY } });
-						billboardVertices.push_back({ { x + .85355f, y + 0, z + .14645f }, { block->sideMaxX, block->sideMinY } });
-						billboardVertices.push_back({ { x + .14645f, y + 1, z + .85355f }, { block->sideMinX, block->sideMaxY } });
-						billboardVertices.push_back({ { x + .85355f, y + 1, z + .14645f }, { block->sideMaxX, block->sideMaxY } });
-
-						billboardIndices.push_back(currentBillboardVertex + 0);
-						billboardIndices.push_back(currentBillboardVertex + 3);
-						billboardIndices.push_back(currentBillboardVertex + 1);
-						billboardIndices.push_back(currentBillboardVertex + 0);
-						billboardIndices.push_back(currentBillboardVertex + 2);
-						billboardIndices.push_back(currentBillboardVertex + 3);
-						currentBillboardVertex += 4;
-
-						continue;
+						int bit = std::countr_zero(face);
+						out[bit - 1] |= 1 << i;
+						size_t isLiquid = liquid >> bit & 1;
+						liquidQuads += isLiquid << (i == FACE_TOP); // Liquid tops get a quad for the underside as well
+						opaqueQuads[i] += isLiquid ^ 1;
 					}
+				}
+				for (uint64_t bits = billboard; bits; bits &= bits - 1)
+				{
+					out[std::countr_zero(bits) - 1] |= 1 << FACE_BILLBOARD;
+					billboards++;
+				}
 
-					// North
-					{
-						int northBlock;
-						if (z > 0)
-						{
-							northBlock = chunkData.GetBlock(x, y, z - 1);
-						}
-						else
-						{
-							if (frontGenerated)
-								northBlock = front->chunkData.GetBlock(x, y, CHUNK_WIDTH - 1);
-							else
-								northBlock = Blocks::AIR;
-						}
-
-						const Block* northBlockType = &Blocks::blocks[northBlock];
-
-						if (northBlockType->blockType == Block::LEAVES
-							|| northBlockType->blockType == Block::TRANSPARENT
-							|| northBlockType->blockType == Block::BILLBOARD
-							|| (northBlockType->blockType == Block::LIQUID && block->blockType != Block::LIQUID))
-						{
-							if (block->blockType == Block::LIQUID)
-							{
-								waterVertices.push_back({ { x + 1, y + 0, z + 0 }, { block->sideMinX, block->sideMinY}, 0 });
-								waterVertices.push_back({ { x + 0, y + 0, z + 0 }, { block->sideMaxX, block->sideMinY}, 0 });
-								waterVertices.push_back({ { x + 1, y + 1, z + 0 }, { block->sideMinX, block->sideMaxY}, 0 });
-								waterVertices.push_back({ { x + 0, y + 1, z + 0 }, { block->sideMaxX, block->sideMaxY}, 0 });
-
-								waterIndices.push_back(currentLiquidVertex + 0);
-								waterIndices.push_back(currentLiquidVertex + 3);
-								waterIndices.push_back(currentLiquidVertex + 1);
-								waterIndices.push_back(currentLiquidVertex + 0);
-								waterIndices.push_back(currentLiquidVertex + 2);
-								waterIndices.push_back(currentLiquidVertex + 3);
-								currentLiquidVertex += 4;
-							}
-							else
-							{
-								mainVertices.push_back({ { x + 1, y + 0, z + 0 }, { block->sideMinX, block->sideMinY}, 0 });
-								mainVertices.push_back({ { x + 0, y + 0, z + 0 }, { block->sideMaxX, block->sideMinY}, 0 });
-								mainVertices.push_back({ { x + 1, y + 1, z + 0 }, { block->sideMinX, block->sideMaxY}, 0 });
-								mainVertices.push_back({ { x + 0, y + 1, z + 0 }, { block->sideMaxX, block->sideMaxY}, 0 });
-
-								mainIndices.push_back(currentVertex + 0);
-								mainIndices.push_back(currentVertex + 3);
-								mainIndices.push_back(currentVertex + 1);
-								mainIndices.push_back(currentVertex + 0);
-								mainIndices.push_back(currentVertex + 2);
-								mainIndices.push_back(currentVertex + 3);
-								currentVertex += 4;
-							}
-						}
-					}
+				uint64_t any = billboard;
+				for (uint64_t face : faces)
+					any |= face;
+				for (; any; any &= any - 1)
+					columnLayers[z * CHUNK_WIDTH + std::countr_zero(any) - 1] |= 1u << y;
+			}
+		}
+	}
 
-					// South
-					{
-						int southBlock;
-						if (z < CHUNK_WIDTH - 1)
-						{
-							southBlock = chunkData.GetBlock(x, y, z + 1);
-						}
-						else
-						{
-							if (backGenerated)
-								southBlock = back->chunkData.GetBlock(x, y, 0);
-							else
-								southBlock = Blocks::AIR;
-						}
-
-						const Block* southBlockType = &Blocks::blocks[southBlock];
-
-						if (southBlockType->blockType == Block::LEAVES
-							|| southBlockType->blockType == Block::TRANSPARENT
-							|| southBlockType->blockType == Block::BILLBOARD
-							|| (southBlockType->blockType == Block::LIQUID && block->blockType != Block::LIQUID))
-						{
-							if (block->blockType == Block::LIQUID)
-							{
-								waterVertices.push_back({ { x + 0, y + 0, z + 1 }, { block->sideMinX, block->sideMinY}, 1 });
-								waterVertices.push_back({ { x + 1, y + 0, z + 1 }, { block->sideMaxX, block->sideMinY}, 1 });
-								waterVertices.push_back({ { x + 0, y + 1, z + 1 }, { block->sideMinX, block->sideMaxY}, 1 });
-								waterVertices.push_back({ { x + 1, y + 1, z + 1 }, { block->sideMaxX, block->sideMaxY}, 1 });
-
-								waterIndices.push_back(currentLiquidVertex + 0);
-								waterIndices.push_back(currentLiquidVertex + 3);
-								waterIndices.push_back(currentLiquidVertex + 1);
-								waterIndices.push_back(currentLiquidVertex + 0);
-								waterIndices.push_back(currentLiquidVertex + 2);
-								waterIndices.push_back(currentLiquidVertex + 3);
-								currentLiquidVertex += 4;
-							}
-							else
-							{
-								mainVertices.push_back({ { x + 0, y + 0, z + 1 }, { block->sideMinX, block->sideMinY}, 1 });
-								mainVertices.push_back({ { x + 1, y + 0, z + 1 }, { block->sideMaxX, block->sideMinY}, 1 });
-								mainVertices.push_back({ { x + 0, y + 1, z + 1 }, { block->sideMinX, block->sideMaxY}, 1 });
-								mainVertices.push_back({ { x + 1, y + 1, z + 1 }, { block->sideMaxX, block->sideMaxY}, 1 });
-
-								mainIndices.push_back(currentVertex + 0);
-								mainIndices.push_back(currentVertex + 3);
-								mainIndices.push_back(currentVertex + 1);
-								mainIndices.push_back(currentVertex + 0);
-								mainIndices.push_back(currentVertex + 2);
-								mainIndices.push_back(currentVertex + 3);
-								currentVertex += 4;
-							}
-						}
-					}
+	// The counts are exact without greedy meshing and an upper bound with it, so the arenas only need to
+	// be checked for room once. They're never shrunk, so once a thread has meshed a few sections this doesn't
+	// allocate at all.
+	PackedQuad* directionStarts[6];
+	PackedQuad* mainQuads = MeshArena::Reserve(meshArena.mainQuads, std::accumulate(opaqueQuads, opaqueQuads + 6, size_t(0)));
+	for (int i = 0; i < 6; i++)
+	{
+		directionStarts[i] = mainQuads;
+		mainQuads += opaqueQuads[i];
+	}
+	MeshOutput out;
+	std::copy_n(directionStarts, 6, out.main);
+	out.water = MeshArena::Reserve(meshArena.waterQuads, liquidQuads);
+	out.billboards = MeshArena::Reserve(meshArena.billboards, billboards);
 
-					// West
-					{
-						int westBlock;
-						if (x > 0)
-						{
-							westBlock = chunkData.GetBlock(x - 1, y, z);
-						}
-						else
-						{
-							if (leftGenerated)
-								westBlock = left->chunkData.GetBlock(CHUNK_WIDTH - 1, y, z);
-							else
-								westBlock = Blocks::AIR;
-						}
-
-						const Block* westBlockType = &Blocks::blocks[westBlock];
-
-						if (westBlockType->blockType == Block::LEAVES
-							|| westBlockType->blockType == Block::TRANSPARENT
-							|| westBlockType->blockType == Block::BILLBOARD
-							|| (westBlockType->blockType == Block::LIQUID && block->blockType != Block::LIQUID))
-						{
-							if (block->blockType == Block::LIQUID)
-							{
-								waterVertices.push_back({ { x + 0, y + 0, z + 0 }, { block->sideMinX, block->sideMinY}, 2 });
-								waterVertices.push_back({ { x + 0, y + 0, z + 1 }, { block->sideMaxX, block->sideMinY}, 2 });
-								waterVertices.push_back({ { x + 0, y + 1, z + 0 }, { block->sideMinX, block->sideMaxY}, 2 });
-								waterVertices.push_back({ { x + 0, y + 1, z + 1 }, { block->sideMaxX, block->sideMaxY}, 2 });
-
-								waterIndices.push_back(currentLiquidVertex + 0);
-								waterIndices.push_back(currentLiquidVertex + 3);
-								waterIndices.push_back(currentLiquidVertex + 1);
-								waterIndices.push_back(currentLiquidVertex + 0);
-								waterIndices.push_back(currentLiquidVertex + 2);
-								waterIndices.push_back(currentLiquidVertex + 3);
-								currentLiquidVertex += 4;
-							}
-							else
-							{
-								mainVertices.push_back({ { x + 0, y + 0, z + 0 }, { block->sideMinX, block->sideMinY}, 2 });
-								mainVertices.push_back({ { x + 0, y + 0, z + 1 }, { block->sideMaxX, block->sideMinY}, 2 });
-								mainVertices.push_back({ { x + 0, y + 1, z + 0 }, { block->sideMinX, block->sideMaxY}, 2 });
-								mainVertices.push_back({ { x + 0, y + 1, z + 1 }, { block->sideMaxX, block->sideMaxY}, 2 });
-
-								mainIndices.push_back(currentVertex + 0);
-								mainIndices.push_back(currentVertex + 3);
-								mainIndices.push_back(currentVertex + 1);
-								mainIndices.push_back(currentVertex + 0);
-								mainIndices.push_back(currentVertex + 2);
-								mainIndices.push_back(currentVertex + 3);
-								currentVertex += 4;
-							}
-						}
-					}
+	for (int x = 0; x < CHUNK_WIDTH; x++)
+	{
+		for (int z = 0; z < CHUNK_WIDTH; z++)
+		{
+			for (uint32_t layerBits = columnLayers[z * CHUNK_WIDTH + x]; layerBits; layerBits &= layerBits - 1)
+			{
+				int y = std::countr_zero(layerBits);
+				int index = y * layerSize + z * CHUNK_WIDTH + x;
+				uint8_t faces = std::exchange(faceBits[index], 0);
+
+				const Block& block = Blocks::blocks[BlockAt(x, y, z)];
+				if (faces & 1 << FACE_BILLBOARD)
+					EmitBillboard(out, x, minY + y, z, block);
+				else if (greedy)
+					RecordFaces(FaceSequence(), faceKeys.data(), faces, block, block.blockType == Block::LIQUID, index);
+				else
+					EmitFaces(FaceSequence(), out, faces, block, block.blockType == Block::LIQUID, x, minY + y, z);
+			}
+		}
+	}
 
-					// East
-					{
-						int eastBlock;
-						if (x < CHUNK_WIDTH - 1)
-						{
-							eastBlock = chunkData.GetBlock(x + 1, y, z);
-						}
-						else
-						{
-							if (rightGenerated)
-								eastBlock = right->chunkData.GetBlock(0, y, z);
-							else
-								eastBlock = Blocks::AIR;
-						}
-
-						const Block* eastBlockType = &Blocks::blocks[eastBlock];
-
-						if (eastBlockType->blockType == Block::LEAVES
-							|| eastBlockType->blockType == Block::TRANSPARENT
-							|| eastBlockType->blockType == Block::BILLBOARD
-							|| (eastBlockType->blockType == Block::LIQUID && block->blockType != Block::LIQUID))
-						{
-							if (block->blockType == Block::LIQUID)
-							{
-								waterVertices.push_back({ { x + 1, y + 0, z + 1 }, { block->sideMinX, block->sideMinY}, 3 });
-								waterVertices.push_back({ { x + 1, y + 0, z + 0 }, { block->sideMaxX, block->sideMinY}, 3 });
-								waterVertices.push_back({ { x + 1, y + 1, z + 1 }, { block->sideMinX, block->sideMaxY}, 3 });
-								waterVertices.push_back({ { x + 1, y + 1, z + 0 }, { block->sideMaxX, block->sideMaxY}, 3 });
-
-								waterIndices.push_back(currentLiquidVertex + 0);
-								waterIndices.push_back(currentLiquidVertex + 3);
-								waterIndices.push_back(currentLiquidVertex + 1);
-								waterIndices.push_back(currentLiquidVertex + 0);
-								waterIndices.push_back(currentLiquidVertex + 2);
-								waterIndices.push_back(currentLiquidVertex + 3);
-								currentLiquidVertex += 4;
-							}
-							else
-							{
-								mainVertices.push_back({ { x + 1, y + 0, z + 1 }, { block->sideMinX, block->sideMinY}, 3 });
-								mainVertices.push_back({ { x + 1, y + 0, z + 0 }, { block->sideMaxX, block->sideMinY}, 3 });
-								mainVertices.push_back({ { x + 1, y + 1, z + 1 }, { block->sideMinX, block->sideMaxY}, 3 });
-								mainVertices.push_back({ { x + 1, y + 1, z + 0 }, { block->sideMaxX, block->sideMaxY}, 3 });
-
-								mainIndices.push_back(currentVertex + 0);
-								mainIndices.push_back(currentVertex + 3);
-								mainIndices.push_back(currentVertex + 1);
-								mainIndices.push_back(currentVertex + 0);
-								mainIndices.push_back(currentVertex + 2);
-								mainIndices.push_back(currentVertex + 3);
-								currentVertex += 4;
-							}
-						}
-					}
+	if (greedy)
+	{
+		ZoneScopedN("Greedy merge");
+		MergeFaces(FaceSequence(), faceKeys.data(), layers, minY, out);
+	}
 
-					// Bottom
-					{
-						int bottomBlock;
-						if (y > 0)
-						{
-							bottomBlock = chunkData.GetBlock(x, y - 1, z);
-						}
-						else
-						{
-							//int blockIndex = x * chunkSize * chunkSize + z * chunkSize + (chunkSize - 1);
-							bottomBlock = Blocks::AIR;
-						}
-
-						const Block* bottomBlockType = &Blocks::blocks[bottomBlock];
-
-						if (bottomBlockType->blockType == Block::LEAVES
-							|| bottomBlockType->blockType == Block::TRANSPARENT
-							|| bottomBlockType->blockType == Block::BILLBOARD
-							|| (bottomBlockType->blockType == Block::LIQUID && block->blockType != Block::LIQUID))
-						{
-							if (block->blockType == Block::LIQUID)
-							{
-								waterVertices.push_back({ { x + 1, y + 0, z + 1 }, { block->bottomMinX, block->bottomMinY}, 4 });
-								waterVertices.push_back({ { x + 0, y + 0, z + 1 }, { block->bottomMaxX, block->bottomMinY}, 4 });
-								waterVertices.push_back({ { x + 1, y + 0, z + 0 }, { block->bottomMinX, block->bottomMaxY}, 4 });
-								waterVertices.push_back({ { x + 0, y + 0, z + 0 }, { block->bottomMaxX, block->bottomMaxY}, 4 });
-
-								waterIndices.push_back(currentLiquidVertex + 0);
-								waterIndices.push_back(currentLiquidVertex + 3);
-								waterIndices.push_back(currentLiquidVertex + 1);
-								waterIndices.push_back(currentLiquidVertex + 0);
-								waterIndices.push_back(currentLiquidVertex + 2);
-								waterIndices.push_back(currentLiquidVertex + 3);
-								currentLiquidVertex += 4;
-							}
-							else
-							{
-								mainVertices.push_back({ { x + 1, y + 0, z + 1 }, { block->bottomMinX, block->bottomMinY}, 4 });
-								mainVertices.push_back({ { x + 0, y + 0, z + 1 }, { block->bottomMaxX, block->bottomMinY}, 4 });
-								mainVertices.push_back({ { x + 1, y + 0, z + 0 }, { block->bottomMinX, block->bottomMaxY}, 4 });
-								mainVertices.push_back({ { x + 0, y + 0, z + 0 }, { block->bottomMaxX, block->bottomMaxY}, 4 });
-
-								mainIndices.push_back(currentVertex + 0);
-								mainIndices.push_back(currentVertex + 3);
-								mainIndices.push_back(currentVertex + 1);
-								mainIndices.push_back(currentVertex + 0);
-								mainIndices.push_back(currentVertex + 2);
-								mainIndices.push_back(currentVertex + 3);
-								currentVertex += 4;
-							}
-						}
-					}
+	// The section only keeps what was written, with one allocation per stream, until PrepareRender uploads it.
+	// Greedy meshing can leave gaps between the directions, those are closed up here. Each direction gets some
+	// free slots after it instead, for edits to be patched into.
+	size_t written = 0;
+	for (int i = 0; i < 6; i++)
+		written += out.main[i] - directionStarts[i];
+	int slack = written ? PATCH_SLACK : 0;
+
+	std::lock_guard lock(meshMutex);
+	mesh.mainQuads.clear();
+	mesh.mainQuads.reserve(written + slack * 6);
+	for (int i = 0; i < 6; i++)
+	{
+		mesh.mainQuads.insert(mesh.mainQuads.end(), directionStarts[i], out.main[i]);
+		mesh.mainQuads.insert(mesh.mainQuads.end(), slack, PackedQuad::Empty());
+		mesh.mainDirectionQuads[i] = out.main[i] - directionStarts[i] + slack;
+	}
+	mesh.waterQuads.assign(meshArena.waterQuads.data(), out.water);
+	mesh.billboards.assign(meshArena.billboards.data(), out.billboards);
+	MarkMeshed(1u << (minY / CHUNK_SECTION_HEIGHT));
+}
 
-					// Top
-					{
-						int topBlock;
-						if (y < CHUNK_HEIGHT - 1)
-						{
-							topBlock = chunkData.GetBlock(x, y + 1, z);
-						}
-						else
-						{
-							//int blockIndex = (x * CHUNK_WIDTH * CHUNK_WIDTH) + (z * CHUNK_HEIGHT) + 0;
-							topBlock = Blocks::AIR;
-						}
-
-						const Block* topBlockType = &Blocks::blocks[topBlock];
-
-						if (block->blockType == Block::LIQUID)
-						{
-							if (topBlockType->blockType != Block::LIQUID)
-							{
-								waterVertices.push_back({ { x + 0, y + 1, z + 1 }, { block->topMinX, block->topMinY}, 5 });
-								waterVertices.push_back({ { x + 1, y + 1, z + 1 }, { block->topMaxX, block->topMinY}, 5 });
-								waterVertices.push_back({ { x + 0, y + 1, z + 0 }, { block->topMinX, block->topMaxY}, 5 });
-								waterVertices.push_back({ { x + 1, y + 1, z + 0 }, { block->topMaxX, block->topMaxY}, 5 });
-
-								waterIndices.push_back(currentLiquidVertex + 0);
-								waterIndices.push_back(currentLiquidVertex + 3);
-								waterIndices.push_back(currentLiquidVertex + 1);
-								waterIndices.push_back(currentLiquidVertex + 0);
-								waterIndices.push_back(currentLiquidVertex + 2);
-								waterIndices.push_back(currentLiquidVertex + 3);
-								currentLiquidVertex += 4;
-
-								waterVertices.push_back({ { x + 1, y + 1, z + 1 }, { block->topMinX, block->topMinY}, 5 });
-								waterVertices.push_back({ { x + 0, y + 1, z + 1 }, { block->topMaxX, block->topMinY}, 5 });
-								waterVertices.push_back({ { x + 1, y + 1, z + 0 }, { block->topMinX, block->topMaxY}, 5 });
-								waterVertices.push_back({ { x + 0, y + 1, z + 0 }, { block->topMaxX, block->topMaxY}, 5 });
-
-								waterIndices.push_back(currentLiquidVertex + 0);
-								waterIndices.push_back(currentLiquidVertex + 3);
-								waterIndices.push_back(currentLiquidVertex + 1);
-								waterIndices.push_back(currentLiquidVertex + 0);
-								waterIndices.push_back(currentLiquidVertex + 2);
-								waterIndices.push_back(currentLiquidVertex + 3);
-								currentLiquidVertex += 4;
-							}
-						}
-						else if (topBlockType->blockType == Block::LEAVES
-							|| topBlockType->blockType == Block::TRANSPARENT
-							|| topBlockType->blockType == Block::BILLBOARD
-							|| topBlockType->blockType == Block::LIQUID)
-						{
-							mainVertices.push_back({ { x + 0, y + 1, z + 1 }, { block->topMinX, block->topMinY}, 5 });
-							mainVertices.push_back({ { x + 1, y + 1, z + 1 }, { block->topMaxX, block->topMinY}, 5 });
-							mainVertices.push_back({ { x + 0, y + 1, z + 0 }, { block->topMinX, block->topMaxY}, 5 });
-							mainVertices.push_back({ { x + 1, y + 1, z + 0 }, { block->topMaxX, block->topMaxY}, 5 });
-
-							mainIndices.push_back(currentVertex + 0);
-							mainIndices.push_back(currentVertex + 3);
-							mainIndices.push_back(currentVertex + 1);
-							mainIndices.push_back(currentVertex + 0);
-							mainIndices.push_back(currentVertex + 2);
-							mainIndices.push_back(currentVertex + 3);
-							currentVertex += 4;
-						}
-					}
-				}
-			}
-		}
+void Chunk::GenerateBorderMesh(const ChunkData& data, const ChunkBorders& borders, int side, BorderMesh& mesh)
+{
+	ZoneScoped;
+
+	// Sides as in surroundedChunks: left, right, front, back
+	static constexpr int sideFaces[4] = { FACE_WEST, FACE_EAST, FACE_NORTH, FACE_SOUTH };
+	int face = sideFaces[side];
+	int plane = side & 1 ? CHUNK_WIDTH - 1 : 0;
+	int height = borders.height;
+
+	static thread_local std::vector<uint16_t> inside;
+	inside.resize(height * CHUNK_WIDTH);
+	if (side < 2)
+		data.CopyXSlab(plane, 0, height, inside.data());
+	else
+		data.CopyZSlab(plane, 0, height, inside.data());
+	const std::vector<uint16_t>* edges[4] = { &borders.negX, &borders.posX, &borders.negZ, &borders.posZ };
+	const uint16_t* outside = edges[side]->empty() ? nullptr : edges[side]->data();
+
+	// Every block of the plane has at most one face here
+	bool greedy = Planet::planet->greedyMeshing;
+	if (greedy && meshArena.faceKeys.size() < faceKeyStride * 6)
+		meshArena.faceKeys.resize(faceKeyStride * 6);
+	MeshOutput out;
+	PackedQuad* mainQuads = MeshArena::Reserve(meshArena.mainQuads, inside.size());
+	std::fill_n(out.main, 6, mainQuads);
+	out.water = MeshArena::Reserve(meshArena.waterQuads, inside.size());
+	out.billboards = nullptr;
+
+	switch (face)
+	{
+	case FACE_WEST: MeshBorderFaces<FACE_WEST>(inside.data(), outside, height, plane, greedy, out); break;
+	case FACE_EAST: MeshBorderFaces<FACE_EAST>(inside.data(), outside, height, plane, greedy, out); break;
+	case FACE_NORTH: MeshBorderFaces<FACE_NORTH>(inside.data(), outside, height, plane, greedy, out); break;
+	case FACE_SOUTH: MeshBorderFaces<FACE_SOUTH>(inside.data(), outside, height, plane, greedy, out); break;
 	}
 
-	//std::cout << "Finished generating in thread: " << std::this_thread::get_id() << '\n';
+	std::lock_guard lock(meshMutex);
+	mesh.mainQuads.assign(mainQuads, out.main[face]);
+	mesh.waterQuads.assign(meshArena.waterQuads.data(), out.water);
+	MarkMeshed(BorderBit(side));
+}
 
-	//std::cout << "Generated: " << generated << '\n';
+void Chunk::MarkMeshed(uint32_t meshes)
+{
+	meshedSections |= meshes;
 	ready = false;
-	generated = true;
 }
 
 void Chunk::PrepareRender()
 {
 	if (!ready && generated && !markedForDelete)
 	{
-		if (mainIndices.size())
-		{
-			Planet::DrawingData& data = Planet::planet->opaqueDrawingData;
-
-			data.vbo.RemoveData(opaqueTri);
-			data.ebo.RemoveData(opaqueEle);
-
-			opaqueTri = data.vbo.AddData(mainVertices.size() * sizeof(Vertex), mainVertices.data());
-			opaqueEle = data.ebo.AddData(mainIndices.size() * sizeof(uint32_t), mainIndices.data());
-
-			mainVertices.clear();
-			mainVertices.shrink_to_fit();
-			mainIndices.clear();
-			mainIndices.shrink_to_fit();
-		}
-
-		if (billboardIndices.size())
+		auto Upload = [](GeoBuffer& buffer, GeoBuffer::Node*& node, auto& data)
 		{
-			Planet::DrawingData& data = Planet::planet->billboardDrawingData;
-
-			data.vbo.RemoveData(billboardTri);
-			data.ebo.RemoveData(billboardEle);
-
-			billboardTri = data.vbo.AddData(billboardVertices.size() * sizeof(BillboardVertex), billboardVertices.data());
-			billboardEle = data.ebo.AddData(billboardIndices.size() * sizeof(uint32_t), billboardIndices.data());
+			buffer.RemoveData(node);
+			node = data.empty() ? nullptr : buffer.AddData(data.size() * sizeof(data[0]), data.data());
+			data.clear();
+			data.shrink_to_fit();
+		};
 
-			billboardVertices.clear();
-			billboardVertices.shrink_to_fit();
-			billboardIndices.clear();
-			billboardIndices.shrink_to_fit();
-		}
+		// Jobs publish their meshes under meshMutex, so none is changed while it's uploaded and one that's
+		// published after this marks the chunk not ready again rather than being missed
+		std::lock_guard lock(meshMutex);
+		ready = true;
 
-		if (waterIndices.size())
+		// Only the sections and border strips meshed since the last upload have changed
+		for (uint32_t meshes = meshedSections.exchange(0); meshes; meshes &= meshes - 1)
 		{
-			Planet::DrawingData& data = Planet::planet->transparentDrawingData;
-
-			data.vbo.RemoveData(waterTri);
-			data.ebo.RemoveData(waterEle);
+			int index = std::countr_zero(meshes);
+			if (index >= CHUNK_SECTION_COUNT)
+			{
+				BorderMesh& border = borderMeshes[index - CHUNK_SECTION_COUNT];
+				Planet::planet->ReserveQuadIndices(std::max(border.mainQuads.size(), border.waterQuads.size()));
+				Upload(Planet::planet->opaqueQuadData.quads, border.opaqueMesh, border.mainQuads);
+				Upload(Planet::planet->transparentQuadData.quads, border.waterMesh, border.waterQuads);
+				continue;
+			}
 
-			waterTri = data.vbo.AddData(waterVertices.size() * sizeof(Vertex), waterVertices.data());
-			waterEle = data.ebo.AddData(waterIndices.size() * sizeof(uint32_t), waterIndices.data());
+			SectionMesh& mesh = sectionMeshes[index];
 
-			waterVertices.clear();
-			waterVertices.shrink_to_fit();
-			waterIndices.clear();
-			waterIndices.shrink_to_fit();
+			Planet::planet->ReserveQuadIndices(std::max({ mesh.mainQuads.size(), mesh.waterQuads.size(), mesh.billboards.size() * 2 }));
+			mesh.opaqueDirectionQuads = mesh.mainDirectionQuads;
+			mesh.opaqueQuads = mesh.mainQuads;
+			mesh.opaqueSlots.reset();
+			Upload(Planet::planet->opaqueQuadData.quads, mesh.opaqueMesh, mesh.mainQuads);
+			Upload(Planet::planet->billboardQuadData.quads, mesh.billboardMesh, mesh.billboards);
+			Upload(Planet::planet->transparentQuadData.quads, mesh.waterMesh, mesh.waterQuads);
 		}
 
 		modelMatrix = glm::mat4(1.0f);
 		modelMatrix = glm::translate(modelMatrix, worldPos);
-
-		ready = true;
 	}
 }
 
@@ -776,6 +825,11 @@ uint16_t Chunk::GetBlockAtPos(int x, int y, int z)
 	if (!ready)
 		return 0;
 
+	Touch();
+
+	std::shared_lock lock(dataMutex);
+	if (y > chunkData.GetHeight(x, z))
+		return Blocks::AIR;
 	return chunkData.GetBlock(x, y, z);
 }
 
@@ -783,19 +837,232 @@ void Chunk::UpdateBlock(int x, int y, int z, uint16_t newBlock)
 {
 	ZoneScoped;
 
-	chunkData.SetBlock(x, y, z, newBlock);
+	// Away from the chunk's sides and the section's top and bottom layers, an edit only changes faces within the section
+	bool inside = x > 0 && x < CHUNK_WIDTH - 1 && z > 0 && z < CHUNK_WIDTH - 1
+		&& y % CHUNK_SECTION_HEIGHT != 0 && y % CHUNK_SECTION_HEIGHT != CHUNK_SECTION_HEIGHT - 1;
+	uint16_t oldBlock;
+	uint16_t neighbours[6] = {};
+	{
+		std::unique_lock lock(dataMutex);
+		lastTouched = glfwGetTime();
+		chunkData.Decompress();
+		oldBlock = chunkData.GetBlock(x, y, z);
+		chunkData.SetBlock(x, y, z, newBlock);
+		memoryUsage = chunkData.GetMemoryUsage();
+		if (inside)
+			for (int face = 0; face < 6; face++)
+				neighbours[face] = chunkData.GetBlock(x + faceOffsets[face].x, y + faceOffsets[face].y, z + faceOffsets[face].z);
+	}
+
+	if (inside && PatchBlock(x, y, z, oldBlock, newBlock, neighbours))
+		return;
+
+	// The blocks above and below can be in the next sections, their faces change too
+	uint32_t sections = 1u << (y / CHUNK_SECTION_HEIGHT);
+	if (y % CHUNK_SECTION_HEIGHT == 0)
+		sections |= sections >> 1;
+	if (y % CHUNK_SECTION_HEIGHT == CHUNK_SECTION_HEIGHT - 1)
+		sections |= (sections << 1) & ALL_SECTIONS;
+
+	// A block on a side has its face towards the neighbour in that side's border strip, the neighbour's strip
+	// along this chunk has faces towards the block
+	uint32_t sides = (x == 0) | (x == CHUNK_WIDTH - 1) << 1 | (z == 0) << 2 | (z == CHUNK_WIDTH - 1) << 3;
+	edgeSides |= sides;
+
+	UpdateChunk(sections | sides << CHUNK_SECTION_COUNT, true);
+}
+
+bool Chunk::PatchBlock(int x, int y, int z, uint16_t oldBlock, uint16_t newBlock, const uint16_t (&neighbours)[6])
+{
+	ZoneScoped;
+
+	int section = y / CHUNK_SECTION_HEIGHT;
+	SectionMesh& mesh = sectionMeshes[section];
+
+	// The uploaded mesh has to be the latest one. A mesh job that's running could have taken its snapshot before
+	// the edit, and one that's done but not uploaded yet would replace the patch.
+	if (!ready || meshing || dirtySections & 1u << section || !mesh.opaqueMesh || mesh.opaqueQuads.empty())
+		return false;
+
+	// Only the opaque mesh is patched, so liquids and billboards need a remesh. So do liquid neighbours, whose
+	// faces are in the water mesh.
+	auto Type = [](uint16_t block) { return Blocks::blocks[block].blockType; };
+	if (Type(oldBlock) == Block::LIQUID || Type(oldBlock) == Block::BILLBOARD || Type(newBlock) == Block::LIQUID || Type(newBlock) == Block::BILLBOARD)
+		return false;
+	for (uint16_t neighbour : neighbours)
+		if (Type(neighbour) == Block::LIQUID)
+			return false;
+	if (oldBlock == newBlock)
+		return true;
+
+	if (!mesh.opaqueSlots)
+	{
+		mesh.opaqueSlots = std::make_unique<QuadSlots>();
+		uint32_t slot = 0;
+		for (int direction = 0; direction < 6; direction++)
+		{
+			for (uint32_t end = slot + mesh.opaqueDirectionQuads[direction]; slot < end; slot++)
+			{
+				if ((mesh.opaqueQuads[slot].position >> 19 & 7) == PackedQuad::EMPTY_FACE)
+					mesh.opaqueSlots->free[direction].push_back(slot);
+				else
+					mesh.opaqueSlots->faces[mesh.opaqueQuads[slot].position] = slot;
+			}
+		}
+	}
+	QuadSlots& slots = *mesh.opaqueSlots;
+
+	// The same visibility rules as the mesher. Neither block is liquid, so a face shows unless the block in front is solid.
+	auto Opaque = [&](uint16_t block) { return block != Blocks::AIR && Type(block) != Block::BILLBOARD; };
+	auto Solid = [&](uint16_t block) { return Type(block) == Block::SOLID; };
+
+	// Faces to take out and put in, the block's own ones and each neighbour's one facing it
+	PackedQuad removed[12], added[12];
+	int removedCount = 0, addedCount = 0;
+	for (int face = 0; face < 6; face++)
+	{
+		uint16_t neighbour = neighbours[face];
+		if (Opaque(oldBlock) && !Solid(neighbour))
+			removed[removedCount++] = PackedQuad(x, y, z, face, 1, 1, GetFaceTile(Blocks::blocks[oldBlock], face));
+		if (Opaque(newBlock) && !Solid(neighbour))
+			added[addedCount++] = PackedQuad(x, y, z, face, 1, 1, GetFaceTile(Blocks::blocks[newBlock], face));
+
+		int facing = face ^ 1;
+		glm::ivec3 pos = glm::ivec3(x, y, z) + faceOffsets[face];
+		bool before = Opaque(neighbour) && !Solid(oldBlock), after = Opaque(neighbour) && !Solid(newBlock);
+		PackedQuad quad(pos.x, pos.y, pos.z, facing, 1, 1, GetFaceTile(Blocks::blocks[neighbour], facing));
+		if (before && !after)
+			removed[removedCount++] = quad;
+		else if (after && !before)
+			added[addedCount++] = quad;
+	}
+
+	// Find the quad each removed face is part of. With greedy meshing that can be a merged quad, which is cut
+	// into the pieces around the face. No two removed faces are in the same quad, they're all in different
+	// directions or slices.
+	uint32_t directionStarts[6] = {};
+	for (int direction = 1; direction < 6; direction++)
+		directionStarts[direction] = directionStarts[direction - 1] + mesh.opaqueDirectionQuads[direction - 1];
+	uint32_t cutSlots[12];
+	PackedQuad pieces[12][4];
+	int pieceCounts[12];
+
+	// Check everything fits before changing anything, a direction that runs out of free slots needs a remesh
+	int freeSlots[6];
+	for (int direction = 0; direction < 6; direction++)
+		freeSlots[direction] = slots.free[direction].size();
+	for (int i = 0; i < removedCount; i++)
+	{
+		int direction = removed[i].position >> 19 & 7;
+		glm::ivec3 cell;
+		int width, height;
+		DecodeQuad(removed[i], cell, width, height);
+
+		auto itr = slots.faces.find(removed[i].position);
+		if (itr != slots.faces.end())
+		{
+			cutSlots[i] = itr->second;
+		}
+		else
+		{
+			uint32_t slot = directionStarts[direction], end = slot + mesh.opaqueDirectionQuads[direction];
+			while (slot < end && !QuadCovers(mesh.opaqueQuads[slot], direction, cell))
+				slot++;
+			if (slot == end)
+				return false;
+			cutSlots[i] = slot;
+		}
+		if (mesh.opaqueQuads[cutSlots[i]].texture != removed[i].texture)
+			return false;
+
+		pieceCounts[i] = CutQuad(mesh.opaqueQuads[cutSlots[i]], cell, pieces[i]);
+		freeSlots[direction] += 1 - pieceCounts[i];
+	}
+	for (int direction = 0; direction < 6; direction++)
+		if (freeSlots[direction] < 0)
+			return false;
+	for (int i = 0; i < addedCount; i++)
+		if (--freeSlots[added[i].position >> 19 & 7] < 0)
+			return false;
+
+	GeoBuffer& buffer = Planet::planet->opaqueQuadData.quads;
+	auto SetSlot = [&](uint32_t slot, const PackedQuad& quad)
+	{
+		mesh.opaqueQuads[slot] = quad;
+		buffer.UpdateData(mesh.opaqueMesh, slot * sizeof(PackedQuad), sizeof(PackedQuad), &quad);
+	};
+	auto AddQuad = [&](const PackedQuad& quad)
+	{
+		std::vector<uint32_t>& free = slots.free[quad.position >> 19 & 7];
+		uint32_t slot = free.back();
+		free.pop_back();
+		slots.faces[quad.position] = slot;
+		SetSlot(slot, quad);
+	};
+	for (int i = 0; i < removedCount; i++)
+	{
+		// The first piece takes the quad's slot, the rest go in free ones
+		uint32_t slot = cutSlots[i];
+		slots.faces.erase(mesh.opaqueQuads[slot].position);
+		if (pieceCounts[i] == 0)
+		{
+			slots.free[removed[i].position >> 19 & 7].push_back(slot);
+			SetSlot(slot, PackedQuad::Empty());
+			continue;
+		}
+		slots.faces[pieces[i][0].position] = slot;
+		SetSlot(slot, pieces[i][0]);
+		for (int piece = 1; piece < pieceCounts[i]; piece++)
+			AddQuad(pieces[i][piece]);
+	}
+	for (int i = 0; i < addedCount; i++)
+		AddQuad(added[i]);
+
+	// Edits that mostly take faces away leave the mesh full of free slots, once they're a good part of it the
+	// section is remeshed to compact it
+	size_t free = 0;
+	for (const std::vector<uint32_t>& directionFree : slots.free)
+		free += directionFree.size();
+	if (free > mesh.opaqueQuads.size() / 4 + PATCH_SLACK * 6)
+		UpdateChunk(1u << section);
+
+	return true;
+}
+
+void Chunk::Touch()
+{
+	lastTouched = glfwGetTime();
+	if (!chunkData.compressed)
+		return;
+
+	std::unique_lock lock(dataMutex, std::try_to_lock);
+	if (!lock.owns_lock())
+		return;
+
+	ZoneScoped;
+	chunkData.Decompress();
+	memoryUsage = chunkData.GetMemoryUsage();
+}
 
-	if (x == 0 || x == CHUNK_WIDTH - 1 || z == 0 || z == CHUNK_WIDTH - 1)
-		edgeUpdate = true;
+std::shared_ptr<const ChunkData> Chunk::GetSnapshot()
+{
+	std::shared_lock lock(dataMutex);
+	std::lock_guard snapshotLock(snapshotMutex);
 
-	UpdateChunk();
+	std::shared_ptr<const ChunkData> current = snapshot.lock();
+	if (!current || current->version != chunkData.version)
+	{
+		current = std::make_shared<const ChunkData>(chunkData);
+		snapshot = current;
+	}
+	return current;
 }
 
-void Chunk::UpdateChunk()
+void Chunk::UpdateChunk(uint32_t meshes, bool urgent)
 {
 	ZoneScoped;
 
-	Planet::planet->AddChunkToGenerate(shared_from_this());
+	Planet::planet->AddChunkToGenerate(shared_from_this(), meshes, urgent);
 
 	//GenerateChunkMesh();
 
@@ -1,8 +1,12 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <array>
+#include <atomic>
 #include <mutex>
+#include <shared_mutex>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "graphics/Buffer.h"
@@ -16,44 +20,123 @@ class Chunk : public std::enable_shared_from_this<Chunk>
 {
 public:
 	typedef std::shared_ptr<Chunk> Ptr;
+	// Mesh masks have a bit per section, then one per border strip with the sides numbered as in surroundedChunks
+	static constexpr uint32_t ALL_SECTIONS = (1u << CHUNK_SECTION_COUNT) - 1;
+	static constexpr uint32_t ALL_BORDERS = 0xFu << CHUNK_SECTION_COUNT;
+	static constexpr uint32_t ALL_MESHES = ALL_SECTIONS | ALL_BORDERS;
+	static_assert(CHUNK_SECTION_COUNT + 4 <= 32, "Mesh masks have a bit per section and border strip");
+	static constexpr uint32_t BorderBit(int side) { return 1u << (CHUNK_SECTION_COUNT + side); }
+
+	// Where each quad is in an uploaded mesh, by the quad's position bits, and the free slots in each
+	// direction's range. Built from SectionMesh::opaqueQuads the first time a section is patched.
+	struct QuadSlots
+	{
+		std::unordered_map<uint32_t, uint32_t> faces;
+		std::vector<uint32_t> free[6];
+	};
+
+	// Meshes are kept per section, so an edit only remeshes and uploads the sections it touches
+	struct SectionMesh
+	{
+		std::vector<PackedQuad> mainQuads;
+		// mainQuads are sorted by direction, this is how many there are of each
+		std::array<uint32_t, 6> mainDirectionQuads = {};
+		std::vector<PackedQuad> waterQuads;
+		std::vector<PackedBillboard> billboards;
+
+		GeoBuffer::Node* opaqueMesh = nullptr;
+		GeoBuffer::Node* billboardMesh = nullptr;
+		GeoBuffer::Node* waterMesh = nullptr;
+		// mainDirectionQuads of the mesh in opaqueMesh
+		std::array<uint32_t, 6> opaqueDirectionQuads = {};
+		// A copy of the mesh in opaqueMesh so single block edits can patch it in place
+		std::vector<PackedQuad> opaqueQuads;
+		std::unique_ptr<QuadSlots> opaqueSlots;
+	};
+
+	// The faces along one side of the chunk that look into the neighbour there, over the chunk's whole height.
+	// They're the only faces that depend on the neighbour, so when it arrives or changes only this is remeshed.
+	struct BorderMesh
+	{
+		std::vector<PackedQuad> mainQuads;
+		std::vector<PackedQuad> waterQuads;
+
+		GeoBuffer::Node* opaqueMesh = nullptr;
+		GeoBuffer::Node* waterMesh = nullptr;
+	};
 
 	Chunk(ChunkPos chunkPos, Shader* shader, Shader* waterShader);
 	~Chunk();
 
-	void GenerateChunkMesh(Chunk::Ptr left, Chunk::Ptr right, Chunk::Ptr front, Chunk::Ptr back);
+	// Neighbours are null when they aren't generated, front is -z and back +z. Only the sections and border strips in the mask are meshed,
+	// the rest keep their meshes.
+	void GenerateChunkMesh(const ChunkData& data, const ChunkData* left, const ChunkData* right, const ChunkData* front, const ChunkData* back,
+		uint32_t meshes = ALL_MESHES);
 	void PrepareRender();
 	void Render(Shader* mainShader, Shader* billboardShader);
 	void RenderWater(Shader* shader);
 	uint16_t GetBlockAtPos(int x, int y, int z);
 	void UpdateBlock(int x, int y, int z, uint16_t newBlock);
-	void UpdateChunk();
+	// Queues the chunk to remesh the given sections and border strips, ahead of everything else when urgent
+	void UpdateChunk(uint32_t meshes = ALL_MESHES, bool urgent = false);
+	// Marks the chunk as in use and decompresses its data. Decompressing is skipped while another
+	// thread holds dataMutex, the data can still be read compressed.
+	void Touch();
+	// Copy of chunkData that stays the same while it's held, for reading without holding dataMutex.
+	// Sections are shared with chunkData until they're changed, and threads asking for the same version share one copy.
+	std::shared_ptr<const ChunkData> GetSnapshot();
 
 public:
 	bool surroundedChunks[4] = {false};
-	std::mutex generatorMutex;
+	// Set while a generator thread owns the chunk. Requests that come in meanwhile set remesh
+	// and the owning thread queues the chunk again once it's done.
+	std::atomic<bool> meshing = false;
+	std::atomic<bool> remesh = false;
+	// Set by urgent requests until the chunk is meshed, the neighbours it queues are urgent as well
+	std::atomic<bool> urgent = false;
+	// Sections and border strips the next mesh job has to mesh again
+	std::atomic<uint32_t> dirtySections = 0;
+	// Mesh jobs run for the chunk so far
+	std::atomic<uint32_t> meshCount = 0;
+	// When the chunk got its blocks, its first mesh waits for the neighbours from then on. deferred is set
+	// while it's in Planet's queue of chunks doing so.
+	std::atomic<double> dataTime = 0;
+	std::atomic<bool> deferred = false;
+	// Shared while chunkData is read or snapshotted, unique while it is generated, edited, compressed or decompressed
+	std::shared_mutex dataMutex;
 	ChunkData chunkData;
+	std::atomic<double> lastTouched = 0;
+	std::atomic<size_t> memoryUsage = 0;
+	size_t uncompressedMemoryUsage = 0;
 	ChunkPos chunkPos;
-	bool ready;
+	// Cleared when a mesh job publishes a mesh, set by PrepareRender once it's uploaded
+	std::atomic<bool> ready;
 	bool generated;
 	bool markedForDelete;
-	bool edgeUpdate;
+	// Sides, numbered as in surroundedChunks, with changes along them. The neighbour there remeshes its border strip facing this chunk.
+	std::atomic<uint32_t> edgeSides = 0;
 
 	glm::vec3 worldPos;
 	glm::mat4 modelMatrix;
 
-	GeoBuffer::Node* opaqueTri = nullptr;
-	GeoBuffer::Node* opaqueEle = nullptr;
-	GeoBuffer::Node* billboardTri = nullptr;
-	GeoBuffer::Node* billboardEle = nullptr;
-	GeoBuffer::Node* waterTri = nullptr;
-	GeoBuffer::Node* waterEle = nullptr;
+	SectionMesh sectionMeshes[CHUNK_SECTION_COUNT];
+	BorderMesh borderMeshes[4];
 
 private:
-	std::vector<Vertex> mainVertices;
-	std::vector<unsigned int> mainIndices;
-	std::vector<Vertex> waterVertices;
-	std::vector<unsigned int> waterIndices;
-	std::vector<BillboardVertex> billboardVertices;
-	std::vector<unsigned int> billboardIndices;
+	// uniform is set when the section is all one solid or liquid block, then only its top and bottom layers are meshed
+	void GenerateSectionMesh(const ChunkData& data, int minY, int maxY, int firstLayer, bool uniform, SectionMesh& mesh);
+	void GenerateBorderMesh(const ChunkData& data, const ChunkBorders& borders, int side, BorderMesh& mesh);
+	// Queues the meshes for PrepareRender to upload, with meshMutex held
+	void MarkMeshed(uint32_t meshes);
+	// Changes the uploaded quads of the block and the faces of its neighbours towards it, neighbours given per
+	// face direction. Returns false when the edit needs a remesh instead.
+	bool PatchBlock(int x, int y, int z, uint16_t oldBlock, uint16_t newBlock, const uint16_t (&neighbours)[6]);
+
+	std::mutex snapshotMutex;
+	std::weak_ptr<const ChunkData> snapshot;
+	// Sections and border strips meshed since PrepareRender last uploaded. Jobs write a mesh's vectors and
+	// mark it here under meshMutex, PrepareRender uploads them under it.
+	std::atomic<uint32_t> meshedSections = 0;
+	std::mutex meshMutex;
 
 };
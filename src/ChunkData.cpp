@@ -1,17 +1,504 @@
 #include "ChunkData.h"
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <tracy/Tracy.hpp>
 #include "Planet.h"
+#include "Blocks.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+static uint8_t BitsForPaletteSize(size_t size)
+{
+	if (size <= 1)
+		return 0;
+	if (size <= 2)
+		return 1;
+	if (size <= 4)
+		return 2;
+	if (size <= 16)
+		return 4;
+	if (size <= 256)
+		return 8;
+	return 16;
+}
+
+// Writes a run for every change of value in values, returns the number of runs
+static size_t EncodeRuns(const uint16_t* values, size_t count, CompressedBlockID* runs)
+{
+	size_t runCount = 0;
+	size_t i = 1;
+
+	// Compare each lane against the one before it, every mismatch ends a run.
+	// movemask gives two bits per 16 bit lane, so they are cleared in pairs.
+#if defined(__AVX2__)
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256i current = _mm256_loadu_si256((const __m256i*)(values + i));
+		__m256i previous = _mm256_loadu_si256((const __m256i*)(values + i - 1));
+		uint32_t changes = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(current, previous));
+		while (changes)
+		{
+			size_t end = i + std::countr_zero(changes) / 2;
+			runs[runCount++] = { (uint16_t)end, values[end - 1] };
+			changes &= changes - 1;
+			changes &= changes - 1;
+		}
+	}
+#elif defined(__SSE2__) || defined(_M_X64)
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i current = _mm_loadu_si128((const __m128i*)(values + i));
+		__m128i previous = _mm_loadu_si128((const __m128i*)(values + i - 1));
+		uint32_t changes = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(current, previous)) & 0xFFFF;
+		while (changes)
+		{
+			size_t end = i + std::countr_zero(changes) / 2;
+			runs[runCount++] = { (uint16_t)end, values[end - 1] };
+			changes &= changes - 1;
+			changes &= changes - 1;
+		}
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		if (values[i] != values[i - 1])
+			runs[runCount++] = { (uint16_t)i, values[i - 1] };
+	}
+
+	runs[runCount++] = { (uint16_t)count, values[count - 1] };
+	return runCount;
+}
+
+static void DecodeRuns(const CompressedBlockID* runs, size_t runCount, uint16_t* values)
+{
+	size_t i = 0;
+	for (size_t run = 0; run < runCount; run++)
+	{
+		size_t end = runs[run].end;
+		uint16_t blockId = runs[run].blockId;
+
+#if defined(__AVX2__)
+		__m256i fill = _mm256_set1_epi16((short)blockId);
+		for (; i + 16 <= end; i += 16)
+			_mm256_storeu_si256((__m256i*)(values + i), fill);
+#elif defined(__SSE2__) || defined(_M_X64)
+		__m128i fill = _mm_set1_epi16((short)blockId);
+		for (; i + 8 <= end; i += 8)
+			_mm_storeu_si128((__m128i*)(values + i), fill);
+#endif
+
+		for (; i < end; i++)
+			values[i] = blockId;
+	}
+}
+
+// Scratch space for a single section worth of block ids or runs
+static thread_local std::vector<uint16_t> sectionBlockIDs(CHUNK_SECTION_BLOCKS);
+static thread_local std::vector<CompressedBlockID> sectionRuns(CHUNK_SECTION_BLOCKS);
+
+// Block id -> palette index, reset after use so it can be reused by the next section on this thread
+static thread_local std::vector<int32_t> paletteLookup(UINT16_MAX + 1, -1);
+
+// ChunkSection
+
+void ChunkSection::Decompress()
+{
+	if (compressedBlockIds.empty())
+		return;
+
+	// Build the palette from the runs, then expand them as palette indices rather than block ids
+	CompressedBlockID* runs = sectionRuns.data();
+	size_t runCount = compressedBlockIds.size();
+	palette.clear();
+	paletteCounts.clear();
+
+	uint16_t start = 0;
+	for (size_t run = 0; run < runCount; run++)
+	{
+		const CompressedBlockID& compressedRun = compressedBlockIds[run];
+		int32_t& paletteIdx = paletteLookup[compressedRun.blockId];
+		if (paletteIdx == -1)
+		{
+			paletteIdx = (int32_t)palette.size();
+			palette.push_back(compressedRun.blockId);
+			paletteCounts.push_back(0);
+		}
+		paletteCounts[paletteIdx] += compressedRun.end - start;
+		runs[run] = { compressedRun.end, (uint16_t)paletteIdx };
+		start = compressedRun.end;
+	}
+	paletteUsed = (uint32_t)palette.size();
+
+	if (palette.size() > 1)
+	{
+		DecodeRuns(runs, runCount, sectionBlockIDs.data());
+		blockIdxs.Allocate(CHUNK_SECTION_BLOCKS, BitsForPaletteSize(palette.size()));
+		blockIdxs.Pack(sectionBlockIDs.data());
+	}
+
+	compressedBlockIds.clear();
+	compressedBlockIds.shrink_to_fit();
+
+	for (uint16_t blockId : palette)
+		paletteLookup[blockId] = -1;
+}
+
+void ChunkSection::Compress()
+{
+	if (IsUniform() || !compressedBlockIds.empty())
+		return;
+
+	CopyStored(0, CHUNK_SECTION_BLOCKS, sectionBlockIDs.data());
+	size_t runCount = EncodeRuns(sectionBlockIDs.data(), CHUNK_SECTION_BLOCKS, sectionRuns.data());
+	compressedBlockIds.assign(sectionRuns.begin(), sectionRuns.begin() + runCount);
+
+	blockIdxs.Free();
+	palette.clear();
+	paletteCounts.clear();
+	paletteUsed = 0;
+}
+
+void ChunkSection::Fill(uint16_t block)
+{
+	compressedBlockIds.clear();
+	compressedBlockIds.shrink_to_fit();
+	blockIdxs.Free();
+	palette = { block };
+	paletteCounts = { CHUNK_SECTION_BLOCKS };
+	paletteUsed = 1;
+}
+
+void ChunkSection::Load(const uint16_t* blockIDs)
+{
+	blockIdxs.Free();
+	palette.clear();
+	paletteCounts.clear();
+
+	for (int i = 0; i < CHUNK_SECTION_BLOCKS; i++)
+	{
+		int32_t& paletteIdx = paletteLookup[blockIDs[i]];
+		if (paletteIdx == -1)
+		{
+			paletteIdx = (int32_t)palette.size();
+			palette.push_back(blockIDs[i]);
+			paletteCounts.push_back(0);
+		}
+		paletteCounts[paletteIdx]++;
+	}
+	paletteUsed = (uint32_t)palette.size();
+
+	if (palette.size() > 1)
+	{
+		uint16_t* paletteIdxs = sectionBlockIDs.data();
+		for (int i = 0; i < CHUNK_SECTION_BLOCKS; i++)
+			paletteIdxs[SectionLayout::ToStorage(i)] = (uint16_t)paletteLookup[blockIDs[i]];
+
+		blockIdxs.Allocate(CHUNK_SECTION_BLOCKS, BitsForPaletteSize(palette.size()));
+		blockIdxs.Pack(paletteIdxs);
+	}
+
+	compressedBlockIds.clear();
+	compressedBlockIds.shrink_to_fit();
+
+	for (uint16_t blockId : palette)
+		paletteLookup[blockId] = -1;
+}
+
+size_t ChunkSection::GetMemoryUsage() const
+{
+	return blockIdxs.GetMemoryUsage()
+		+ compressedBlockIds.capacity() * sizeof(CompressedBlockID)
+		+ palette.capacity() * sizeof(uint16_t)
+		+ paletteCounts.capacity() * sizeof(uint32_t);
+}
+
+uint16_t ChunkSection::GetBlock(int index) const
+{
+	index = SectionLayout::ToStorage(index);
+	if (!compressedBlockIds.empty())
+		return compressedBlockIds[FindRun(index)].blockId;
+	else if (!blockIdxs.GetData())
+		return palette[0];
+	else
+		return palette[blockIdxs.Get(index)];
+}
+
+void ChunkSection::SetBlock(int index, uint16_t block)
+{
+	index = SectionLayout::ToStorage(index);
+	if (!compressedBlockIds.empty())
+	{
+		SetCompressedBlock(index, block);
+		// Edits can merge the runs down to one, which is a uniform section, otherwise give back what erased runs left over
+		if (compressedBlockIds.size() == 1)
+			Fill(compressedBlockIds[0].blockId);
+		else if (compressedBlockIds.capacity() >= compressedBlockIds.size() * 2 + 16)
+			compressedBlockIds.shrink_to_fit();
+		return;
+	}
+
+	if (!blockIdxs.GetData())
+	{
+		if (palette[0] == block)
+			return;
+
+		// First edit of a uniform section, everything else stays at palette index 0
+		blockIdxs.Allocate(CHUNK_SECTION_BLOCKS, 1);
+	}
+
+	uint32_t oldIdx = blockIdxs.Get(index);
+	if (palette[oldIdx] == block)
+		return;
+
+	if (--paletteCounts[oldIdx] == 0)
+		paletteUsed--;
+
+	uint32_t newIdx = GetPaletteIndex(block);
+	paletteCounts[newIdx]++;
+	blockIdxs.Set(index, newIdx);
+
+	if (paletteCounts[oldIdx] == 0)
+		ShrinkPalette();
+}
+
+uint32_t ChunkSection::GetPaletteIndex(uint16_t block)
+{
+	uint32_t freeIdx = UINT32_MAX;
+	for (uint32_t i = 0; i < palette.size(); i++)
+	{
+		if (paletteCounts[i] == 0)
+		{
+			if (freeIdx == UINT32_MAX)
+				freeIdx = i;
+		}
+		else if (palette[i] == block)
+			return i;
+	}
+
+	paletteUsed++;
+	if (freeIdx != UINT32_MAX)
+	{
+		palette[freeIdx] = block;
+		return freeIdx;
+	}
+
+	palette.push_back(block);
+	paletteCounts.push_back(0);
+
+	// Widen the indices once the palette no longer fits
+	uint8_t bits = BitsForPaletteSize(palette.size());
+	if (bits > blockIdxs.GetBits())
+	{
+		ZoneScopedN("ChunkSection::GetPaletteIndex widen");
+		blockIdxs.Resize(bits);
+	}
+
+	return (uint32_t)palette.size() - 1;
+}
+
+void ChunkSection::ShrinkPalette()
+{
+	// Back to a single block, drop the indices entirely
+	if (paletteUsed == 1)
+	{
+		auto itr = std::find_if(paletteCounts.begin(), paletteCounts.end(), [](uint32_t count) { return count != 0; });
+		Fill(palette[itr - paletteCounts.begin()]);
+		return;
+	}
+
+	// Only narrow once the used entries fit in half of the smaller width, so
+	// toggling a single block around a boundary doesn't repack every edit.
+	if (BitsForPaletteSize(paletteUsed * 2) >= blockIdxs.GetBits())
+		return;
+	ZoneScoped;
+
+	std::vector<uint32_t> remap(palette.size());
+	std::vector<uint16_t> newPalette;
+	std::vector<uint32_t> newCounts;
+	for (uint32_t i = 0; i < palette.size(); i++)
+	{
+		if (paletteCounts[i] == 0)
+			continue;
+		remap[i] = (uint32_t)newPalette.size();
+		newPalette.push_back(palette[i]);
+		newCounts.push_back(paletteCounts[i]);
+	}
+
+	PackedArray newIdxs(CHUNK_SECTION_BLOCKS, BitsForPaletteSize(newPalette.size()));
+	for (int i = 0; i < CHUNK_SECTION_BLOCKS; i++)
+		newIdxs.Set(i, remap[blockIdxs.Get(i)]);
+
+	blockIdxs = std::move(newIdxs);
+	palette = std::move(newPalette);
+	paletteCounts = std::move(newCounts);
+}
+
+void ChunkSection::CopyBlocks(int index, int count, uint16_t* out) const
+{
+	if (SectionLayout::IS_LINEAR || IsUniform())
+	{
+		CopyStored(index, count, out);
+		return;
+	}
+
+	// Ranges aren't contiguous in storage, so gather them a block at a time
+	for (int i = 0; i < count; i++)
+		out[i] = GetBlock(index + i);
+}
+
+void ChunkSection::GatherBlocks(int index, int stride, int count, uint16_t* out) const
+{
+	if (IsUniform())
+	{
+		std::fill_n(out, count, palette[0]);
+		return;
+	}
+
+	for (int i = 0; i < count; i++)
+		out[i] = GetBlock(index + i * stride);
+}
+
+void ChunkSection::CopyStored(int index, int count, uint16_t* out) const
+{
+	if (IsUniform())
+	{
+		std::fill_n(out, count, palette[0]);
+	}
+	else if (!compressedBlockIds.empty())
+	{
+		int end = index + count;
+		for (size_t run = FindRun(index); index < end; run++)
+		{
+			int runEnd = std::min((int)compressedBlockIds[run].end, end);
+			out = std::fill_n(out, runEnd - index, compressedBlockIds[run].blockId);
+			index = runEnd;
+		}
+	}
+	else
+	{
+		blockIdxs.Unpack(index, count, out);
+		for (int i = 0; i < count; i++)
+			out[i] = palette[out[i]];
+	}
+}
+
+const CompressedBlockID* ChunkSection::GetRuns(size_t& count) const
+{
+	if (SectionLayout::IS_LINEAR && !compressedBlockIds.empty())
+	{
+		count = compressedBlockIds.size();
+		return compressedBlockIds.data();
+	}
+
+	if (IsUniform())
+	{
+		sectionRuns[0] = { (uint16_t)CHUNK_SECTION_BLOCKS, palette[0] };
+		count = 1;
+		return sectionRuns.data();
+	}
+
+	CopyBlocks(0, CHUNK_SECTION_BLOCKS, sectionBlockIDs.data());
+	count = EncodeRuns(sectionBlockIDs.data(), CHUNK_SECTION_BLOCKS, sectionRuns.data());
+	return sectionRuns.data();
+}
+
+size_t ChunkSection::FindRun(int index) const
+{
+	// First run that ends after index
+	auto itr = std::upper_bound(compressedBlockIds.begin(), compressedBlockIds.end(), index,
+		[](int index, const CompressedBlockID& run) { return index < run.end; });
+	assert(itr != compressedBlockIds.end() && "Failed to find block in compressed runs???");
+	return itr - compressedBlockIds.begin();
+}
+
+void ChunkSection::SetCompressedBlock(int index, uint16_t block)
+{
+	size_t run = FindRun(index);
+	if (compressedBlockIds[run].blockId == block)
+		return;
+
+	int start = run > 0 ? compressedBlockIds[run - 1].end : 0;
+	int end = compressedBlockIds[run].end;
+	bool prevMatches = run > 0 && compressedBlockIds[run - 1].blockId == block;
+	bool nextMatches = run + 1 < compressedBlockIds.size() && compressedBlockIds[run + 1].blockId == block;
+
+	// Single block run, replace it and merge with whichever neighbours now match
+	if (end - start == 1)
+	{
+		compressedBlockIds[run].blockId = block;
+		if (nextMatches)
+		{
+			compressedBlockIds[run].end = compressedBlockIds[run + 1].end;
+			compressedBlockIds.erase(compressedBlockIds.begin() + run + 1);
+		}
+		if (prevMatches)
+		{
+			compressedBlockIds[run - 1].end = compressedBlockIds[run].end;
+			compressedBlockIds.erase(compressedBlockIds.begin() + run);
+		}
+		return;
+	}
+
+	// Edge of a run, move the boundary into the matching neighbour
+	if (index == start && prevMatches)
+	{
+		compressedBlockIds[run - 1].end++;
+		return;
+	}
+	if (index == end - 1 && nextMatches)
+	{
+		compressedBlockIds[run].end--;
+		return;
+	}
+
+	// Split into [start, index) [index] [index + 1, end), leaving out the empty parts
+	uint16_t oldBlock = compressedBlockIds[run].blockId;
+	if (index == start)
+	{
+		compressedBlockIds.insert(compressedBlockIds.begin() + run, CompressedBlockID{ (uint16_t)(index + 1), block });
+	}
+	else if (index == end - 1)
+	{
+		compressedBlockIds[run].end = (uint16_t)index;
+		compressedBlockIds.insert(compressedBlockIds.begin() + run + 1, CompressedBlockID{ (uint16_t)end, block });
+	}
+	else
+	{
+		compressedBlockIds[run].end = (uint16_t)index;
+		CompressedBlockID split[2] = { { (uint16_t)(index + 1), block }, { (uint16_t)end, oldBlock } };
+		compressedBlockIds.insert(compressedBlockIds.begin() + run + 1, split, split + 2);
+	}
+}
+
+// ChunkData
+
+// Every chunk starts out pointing at the same air section
+static const std::shared_ptr<ChunkSection>& EmptySection()
+{
+	static const std::shared_ptr<ChunkSection> section = std::make_shared<ChunkSection>();
+	return section;
+}
 
 ChunkData::ChunkData()
 {
 	ZoneScoped;
+
+	sections.fill(EmptySection());
+
+	heightMap.fill(-1);
+	exposedMap.fill(0);
 }
 
 ChunkData::~ChunkData()
 {
 	ZoneScoped;
-	delete[] blockIDs;
 }
 
 void ChunkData::Decompress()
@@ -20,21 +507,12 @@ void ChunkData::Decompress()
 		return;
 	ZoneScoped;
 
-	blockIDs = new uint16_t[CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_WIDTH];
-
-	auto itr = compressedBlockIds.begin();
-	for (int i = 0, j = 0; i < CHUNK_HEIGHT * CHUNK_WIDTH * CHUNK_WIDTH; i++)
+	for (int i = 0; i < CHUNK_SECTION_COUNT; i++)
 	{
-		if (i >= j + itr->size)
-		{
-			j += itr->size;
-			itr++;
-		}
-
-		blockIDs[i] = itr->blockId;
+		if (!sections[i]->compressedBlockIds.empty())
+			EditSection(i).Decompress();
 	}
 
-	compressedBlockIds.clear();
 	compressed = false;
 }
 
@@ -44,81 +522,216 @@ void ChunkData::Compress()
 		return;
 	ZoneScoped;
 
-	//std::vector<CompressedBlockID> compressedSections;
-	//CompressedBlockID compressedSection{UINT16_MAX,UINT16_MAX};
-	compressedBlockIds.emplace_back(CompressedBlockID{ 1, blockIDs[0] });
-	auto itr = compressedBlockIds.begin();
-	for (int i = 1; i < CHUNK_HEIGHT * CHUNK_WIDTH * CHUNK_WIDTH; i++)
+	for (int i = 0; i < CHUNK_SECTION_COUNT; i++)
 	{
-		if (itr->size == UINT16_MAX || itr->blockId != blockIDs[i])
+		if (!sections[i]->IsUniform() && sections[i]->compressedBlockIds.empty())
+			EditSection(i).Compress();
+	}
+
+	compressed = true;
+}
+
+void ChunkData::Load(const uint16_t* blockIDs, int height)
+{
+	ZoneScoped;
+
+	for (int i = 0; i < CHUNK_SECTION_COUNT; i++)
+	{
+		if (i * (int)CHUNK_SECTION_HEIGHT >= height)
 		{
-			compressedBlockIds.emplace_back(CompressedBlockID{ 1, blockIDs[i] });
-			itr++;
+			sections[i] = EmptySection();
 		}
 		else
-			itr->size++;
+		{
+			sections[i] = std::make_shared<ChunkSection>();
+			sections[i]->Load(blockIDs + i * CHUNK_SECTION_BLOCKS);
+		}
 	}
+	compressed = false;
+	version++;
 
-	//compressedBlockIds.resize(); = new CompressedBlockID[compressedSections.size()];
-	//for (int i = 0; i < compressedSections.size(); i++)
-	//{
-	//	compressedBlockIds[i].size = compressedSections[i].size;
-	//	compressedBlockIds[i].blockId = compressedSections[i].blockId;
-	//	if (i > 0)
-	//		compressedBlockIds[i - 1].next = &compressedSections[i];
-	//}
+	constexpr int layerSize = CHUNK_WIDTH * CHUNK_WIDTH;
+	for (int column = 0; column < layerSize; column++)
+	{
+		int top = std::min(height, (int)CHUNK_HEIGHT) - 1;
+		while (top >= 0 && blockIDs[column + top * layerSize] == Blocks::AIR)
+			top--;
 
-	delete[] blockIDs;
-	blockIDs = nullptr;
-	compressed = true;
+		int exposed = 0;
+		while (exposed <= top && Blocks::blocks[blockIDs[column + exposed * layerSize]].blockType == Block::SOLID)
+			exposed++;
+
+		heightMap[column] = (int16_t)top;
+		exposedMap[column] = (int16_t)exposed;
+	}
 }
 
-__forceinline int ChunkData::GetIndex(int x, int y, int z)
+size_t ChunkData::GetMemoryUsage() const
 {
-	return (y * CHUNK_WIDTH * CHUNK_WIDTH) + (x) + (z * CHUNK_WIDTH);
+	size_t size = 0;
+	for (const std::shared_ptr<ChunkSection>& section : sections)
+		size += section->GetMemoryUsage();
+	return size;
+}
 
-	//return (x * CHUNK_WIDTH * CHUNK_WIDTH) + (z * CHUNK_HEIGHT) + y;
+int ChunkData::GetMaxHeight() const
+{
+	return *std::max_element(heightMap.begin(), heightMap.end());
 }
 
-__forceinline int ChunkData::GetIndex(ChunkPos localBlockPos)
+void ChunkData::CopyBlocks(int index, int count, uint16_t* out) const
 {
-	return GetIndex(localBlockPos.x, localBlockPos.y, localBlockPos.z);
+	while (count > 0)
+	{
+		int sectionIndex = index % CHUNK_SECTION_BLOCKS;
+		int sectionCount = std::min(count, (int)CHUNK_SECTION_BLOCKS - sectionIndex);
+		sections[index / CHUNK_SECTION_BLOCKS]->CopyBlocks(sectionIndex, sectionCount, out);
+		index += sectionCount;
+		count -= sectionCount;
+		out += sectionCount;
+	}
 }
 
-uint16_t ChunkData::GetBlock(ChunkPos blockPos)
+void ChunkData::CopySlab(int y, uint16_t* out) const
 {
-	int index = GetIndex(blockPos);
-	return GetBlock(index);
+	CopyBlocks(GetIndex(0, y, 0), CHUNK_WIDTH * CHUNK_WIDTH, out);
 }
 
-uint16_t ChunkData::GetBlock(int x, int y, int z)
+void ChunkData::CopyRow(int y, int z, uint16_t* out) const
 {
-	int index = GetIndex(x, y, z);
-	return GetBlock(index);
+	CopyBlocks(GetIndex(0, y, z), CHUNK_WIDTH, out);
 }
 
-uint16_t ChunkData::GetBlock(int index)
+void ChunkData::CopyXSlab(int x, int minY, int maxY, uint16_t* out) const
 {
-	if (compressed)
+	for (int y = minY; y < maxY; y++, out += CHUNK_WIDTH)
+		sections[y / CHUNK_SECTION_HEIGHT]->GatherBlocks(GetIndex(x, y % CHUNK_SECTION_HEIGHT, 0), CHUNK_WIDTH, CHUNK_WIDTH, out);
+}
+
+void ChunkData::CopyZSlab(int z, int minY, int maxY, uint16_t* out) const
+{
+	for (int y = minY; y < maxY; y++, out += CHUNK_WIDTH)
+		CopyRow(y, z, out);
+}
+
+void ChunkData::CopyPadded(int minY, int maxY, uint16_t* out, const ChunkBorders& borders) const
+{
+	ZoneScoped;
+
+	constexpr int paddedLayerSize = PADDED_CHUNK_WIDTH * PADDED_CHUNK_WIDTH;
+	constexpr int layerBlocks = CHUNK_WIDTH * CHUNK_WIDTH;
+	std::fill_n(out, (maxY - minY + 2) * paddedLayerSize, (uint16_t)Blocks::AIR);
+
+	int firstY = std::max(minY - 1, 0), lastY = std::min(maxY + 1, (int)CHUNK_HEIGHT);
+	uint16_t slab[layerBlocks];
+	for (int y = firstY; y < lastY;)
 	{
-		auto itr = compressedBlockIds.begin();
-		int i = 0;
-		while (i <= index && itr != compressedBlockIds.end())
+		int section = y / CHUNK_SECTION_HEIGHT;
+		int sectionY = section * CHUNK_SECTION_HEIGHT;
+		int sectionEnd = std::min(lastY, sectionY + (int)CHUNK_SECTION_HEIGHT);
+		const ChunkSection& blocks = *sections[section];
+
+		// Compressed sections are swept a run at a time over all the layers needed from them, rather than
+		// looking the runs up again for every layer. Only in index order, other layouts store the runs out of it.
+		if (SectionLayout::IS_LINEAR && !blocks.compressedBlockIds.empty())
 		{
-			if (i + itr->size > index)
+			blocks.ForEachStoredRun((y - sectionY) * layerBlocks, (sectionEnd - sectionY) * layerBlocks, [&](int index, int count, uint16_t block)
 			{
-				return itr->blockId;
-			}
+				while (count > 0)
+				{
+					int x = index % CHUNK_WIDTH, z = index / CHUNK_WIDTH % CHUNK_WIDTH;
+					int layer = sectionY + index / layerBlocks - minY + 1;
+					int rowCount = std::min(count, (int)CHUNK_WIDTH - x);
+					std::fill_n(out + layer * paddedLayerSize + (z + 1) * PADDED_CHUNK_WIDTH + x + 1, rowCount, block);
+					index += rowCount;
+					count -= rowCount;
+				}
+			});
+			y = sectionEnd;
+			continue;
+		}
 
-			i += itr->size;
-			itr++;
+		for (; y < sectionEnd; y++)
+		{
+			uint16_t* layer = out + (y - minY + 1) * paddedLayerSize;
+			CopySlab(y, slab);
+			for (int z = 0; z < CHUNK_WIDTH; z++)
+				std::copy_n(slab + z * CHUNK_WIDTH, CHUNK_WIDTH, layer + (z + 1) * PADDED_CHUNK_WIDTH + 1);
 		}
+	}
 
-		assert(false && "Failed to find block in compressed list???");
-		return 0;
+	for (int y = firstY; y < std::min(lastY, borders.height); y++)
+	{
+		uint16_t* layer = out + (y - minY + 1) * paddedLayerSize;
+
+		int edge = y * CHUNK_WIDTH;
+		if (!borders.negZ.empty())
+			std::copy_n(borders.negZ.data() + edge, CHUNK_WIDTH, layer + 1);
+		if (!borders.posZ.empty())
+			std::copy_n(borders.posZ.data() + edge, CHUNK_WIDTH, layer + (CHUNK_WIDTH + 1) * PADDED_CHUNK_WIDTH + 1);
+		if (!borders.negX.empty())
+			for (int z = 0; z < CHUNK_WIDTH; z++)
+				layer[(z + 1) * PADDED_CHUNK_WIDTH] = borders.negX[edge + z];
+		if (!borders.posX.empty())
+			for (int z = 0; z < CHUNK_WIDTH; z++)
+				layer[(z + 1) * PADDED_CHUNK_WIDTH + CHUNK_WIDTH + 1] = borders.posX[edge + z];
 	}
-	else
-		return blockIDs[index];
+}
+
+void ChunkBorders::Extract(int layers, const ChunkData* negXChunk, const ChunkData* posXChunk, const ChunkData* negZChunk, const ChunkData* posZChunk)
+{
+	ZoneScoped;
+
+	height = std::min(layers, (int)CHUNK_HEIGHT);
+	auto Side = [&](std::vector<uint16_t>& side, const ChunkData* chunk, void (ChunkData::*copy)(int, int, int, uint16_t*) const, int plane)
+	{
+		side.clear();
+		if (!chunk)
+			return;
+		side.resize(height * CHUNK_WIDTH);
+		(chunk->*copy)(plane, 0, height, side.data());
+	};
+	Side(negX, negXChunk, &ChunkData::CopyXSlab, CHUNK_WIDTH - 1);
+	Side(posX, posXChunk, &ChunkData::CopyXSlab, 0);
+	Side(negZ, negZChunk, &ChunkData::CopyZSlab, CHUNK_WIDTH - 1);
+	Side(posZ, posZChunk, &ChunkData::CopyZSlab, 0);
+}
+
+bool ChunkData::IsSectionUniform(int section, uint16_t& block) const
+{
+	if (!sections[section]->IsUniform())
+		return false;
+	block = sections[section]->palette[0];
+	return true;
+}
+
+__forceinline int ChunkData::GetIndex(int x, int y, int z)
+{
+	// Always linear, sections apply SectionLayout to their part of it
+	return (y * CHUNK_WIDTH * CHUNK_WIDTH) + (x) + (z * CHUNK_WIDTH);
+}
+
+__forceinline int ChunkData::GetIndex(ChunkPos localBlockPos)
+{
+	return GetIndex(localBlockPos.x, localBlockPos.y, localBlockPos.z);
+}
+
+uint16_t ChunkData::GetBlock(ChunkPos blockPos) const
+{
+	int index = GetIndex(blockPos);
+	return GetBlock(index);
+}
+
+uint16_t ChunkData::GetBlock(int x, int y, int z) const
+{
+	int index = GetIndex(x, y, z);
+	return GetBlock(index);
+}
+
+uint16_t ChunkData::GetBlock(int index) const
+{
+	// Sections are stacked along y, which is the outermost part of the index
+	return sections[index / CHUNK_SECTION_BLOCKS]->GetBlock(index % CHUNK_SECTION_BLOCKS);
 }
 
 void ChunkData::SetBlock(ChunkPos pos, uint16_t block)
@@ -135,38 +748,46 @@ void ChunkData::SetBlock(int x, int y, int z, uint16_t block)
 
 void ChunkData::SetBlock(int index, uint16_t block)
 {
-	if (compressed)
+	if (GetBlock(index) == block)
+		return;
+
+	EditSection(index / CHUNK_SECTION_BLOCKS).SetBlock(index % CHUNK_SECTION_BLOCKS, block);
+	version++;
+	UpdateColumnBounds(index % (CHUNK_WIDTH * CHUNK_WIDTH), index / (CHUNK_WIDTH * CHUNK_WIDTH), block);
+}
+
+ChunkSection& ChunkData::EditSection(int i)
+{
+	// Only the owner copies sections, so the count can't go up between checking it and writing. A count of one
+	// can come from another thread dropping the last snapshot that shared the section, and use_count() doesn't
+	// order that thread's reads before the writes here, the fence pairs with the release of its decrement.
+	if (sections[i].use_count() > 1)
+		sections[i] = std::make_shared<ChunkSection>(*sections[i]);
+	else
+		std::atomic_thread_fence(std::memory_order_acquire);
+	return *sections[i];
+}
+
+void ChunkData::UpdateColumnBounds(int column, int y, uint16_t block)
+{
+	constexpr int layerSize = CHUNK_WIDTH * CHUNK_WIDTH;
+
+	// Only removing the current top or filling in the current lowest exposed block needs a rescan
+	int16_t& height = heightMap[column];
+	if (block != Blocks::AIR)
+		height = std::max(height, (int16_t)y);
+	else if (y == height)
 	{
-		auto itr = compressedBlockIds.begin();
-		int i = 0;
-		while (i <= index)
-		{
-			if (i + itr->size > index)
-			{
-				auto itr2 = itr;
-				itr2++;
-				if (index == i + itr->size - 1 && itr2->blockId == block)
-				{
-					itr->size -= 1;
-					itr2->size += 1;
-					return;
-				}
-				else
-				{
-					uint16_t oldBlock = itr->blockId;
-					uint16_t oldSize = itr->size;
-					itr->size = (index - i) + 1;
-					oldSize -= itr->size + 1;
-					compressedBlockIds.emplace(++itr, CompressedBlockID{ 1, block });
-					compressedBlockIds.emplace(++itr, CompressedBlockID{ oldSize, oldBlock });
-					return;
-				}
-			}
+		while (height >= 0 && GetBlock(column + height * layerSize) == Blocks::AIR)
+			height--;
+	}
 
-			i += itr->size;
-			itr++;
-		}
+	int16_t& exposed = exposedMap[column];
+	if (Blocks::blocks[block].blockType != Block::SOLID)
+		exposed = std::min(exposed, (int16_t)y);
+	else if (y == exposed)
+	{
+		while (exposed <= height && Blocks::blocks[GetBlock(column + exposed * layerSize)].blockType == Block::SOLID)
+			exposed++;
 	}
-	else
-		blockIDs[index] = block;
 }
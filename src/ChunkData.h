@@ -1,41 +1,229 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
-#include <list>
+#include <memory>
+#include <vector>
 
 #include "ChunkPos.h"
+#include "utils/PackedArray.h"
 
-struct ChunkData
+constexpr unsigned int CHUNK_WIDTH = 32; // x/z
+constexpr unsigned int CHUNK_HEIGHT = 512; // y
+constexpr unsigned int CHUNK_SECTION_HEIGHT = 32;
+constexpr unsigned int CHUNK_SECTION_COUNT = CHUNK_HEIGHT / CHUNK_SECTION_HEIGHT;
+constexpr unsigned int CHUNK_SECTION_BLOCKS = CHUNK_WIDTH * CHUNK_SECTION_HEIGHT * CHUNK_WIDTH;
+constexpr unsigned int PADDED_CHUNK_WIDTH = CHUNK_WIDTH + 2; // One block border on each side
+
+// Order blocks are stored in within a section. Indices into a section are always linear,
+// x + z * CHUNK_WIDTH + y * CHUNK_WIDTH * CHUNK_WIDTH, and the layout maps them to where they're stored.
+// Chosen at compile time with CHUNK_SECTION_LAYOUT, see SCUFFED_SECTION_LAYOUT in CMakeLists.txt.
+static_assert(CHUNK_WIDTH == 32 && CHUNK_SECTION_HEIGHT == 32, "Section layouts assume 32x32x32 sections");
+
+// Rows along x, then z, then y. The same order as the index.
+struct LinearLayout
 {
-#pragma pack(push,1)
-	struct CompressedBlockID
+	static constexpr const char* NAME = "Linear";
+	static constexpr bool IS_LINEAR = true;
+	static constexpr int ToStorage(int index) { return index; }
+};
+
+// 4x4x4 tiles one after another, so neighbours along every axis are usually in the same cache line
+struct TiledLayout
+{
+	static constexpr const char* NAME = "4x4x4 tiled";
+	static constexpr bool IS_LINEAR = false;
+	static constexpr int ToStorage(int index)
+	{
+		int x = index & 31, z = (index >> 5) & 31, y = index >> 10;
+		int tile = (x >> 2) + (z >> 2) * 8 + (y >> 2) * 64;
+		return tile * 64 + (x & 3) + (z & 3) * 4 + (y & 3) * 16;
+	}
+};
+
+// Morton (Z-order) curve, interleaving the bits of x, z and y
+struct MortonLayout
+{
+	static constexpr const char* NAME = "Morton";
+	static constexpr bool IS_LINEAR = false;
+	static constexpr int ToStorage(int index)
+	{
+		return Spread(index & 31) | Spread((index >> 5) & 31) << 1 | Spread(index >> 10) << 2;
+	}
+
+private:
+	// Moves bit n of a 5 bit value to bit 3n
+	static constexpr int Spread(int v)
 	{
-		uint16_t size;
-		uint16_t blockId;
-	};
+		v = (v | v << 8) & 0x0300F00F;
+		v = (v | v << 4) & 0x030C30C3;
+		v = (v | v << 2) & 0x09249249;
+		return v;
+	}
+};
+
+#ifndef CHUNK_SECTION_LAYOUT
+#define CHUNK_SECTION_LAYOUT LinearLayout
+#endif
+using SectionLayout = CHUNK_SECTION_LAYOUT;
+
+#pragma pack(push,1)
+struct CompressedBlockID
+{
+	uint16_t end; // Index one past the last block of the run, the runs before it sum up to this
+	uint16_t blockId;
+};
 #pragma pack(pop)
-	//uint16_t* pallet;
-	//Bitset blockIdxs;
 
-	uint16_t* blockIDs = nullptr;
-	std::list<CompressedBlockID> compressedBlockIds;
+// A CHUNK_WIDTH x CHUNK_SECTION_HEIGHT x CHUNK_WIDTH slice of a chunk.
+// Sections made of a single block keep just that palette entry and no index storage.
+struct ChunkSection
+{
+	// Block ids used by the section, blockIdxs stores an index into this per block.
+	// Entries with a count of 0 are free and get reused before the palette grows.
+	std::vector<uint16_t> palette = { 0 };
+	std::vector<uint32_t> paletteCounts = { CHUNK_SECTION_BLOCKS };
+	uint32_t paletteUsed = 1;
+	PackedArray blockIdxs;
+
+	// Runs of blocks in storage order while compressed, sorted by end so lookups can binary search.
+	std::vector<CompressedBlockID> compressedBlockIds;
+
+	bool IsUniform() const { return !blockIdxs.GetData() && compressedBlockIds.empty(); }
+
+	void Decompress();
+	void Compress();
+
+	void Fill(uint16_t block);
+	void Load(const uint16_t* blockIDs);
+	size_t GetMemoryUsage() const;
+
+	uint16_t GetBlock(int index) const;
+	void SetBlock(int index, uint16_t block);
+
+	// Copies count blocks starting at index into out, branching on the storage once rather than per block.
+	void CopyBlocks(int index, int count, uint16_t* out) const;
+	// Copies count blocks starting at index, stride apart, into out.
+	void GatherBlocks(int index, int stride, int count, uint16_t* out) const;
+	// Returns the section's runs in index order. Unless the section is compressed these are built into
+	// per-thread scratch, so they're only valid until the next call on this thread.
+	const CompressedBlockID* GetRuns(size_t& count) const;
+
+	// Calls func(index, count, blockId) for the runs of a compressed section that cover [begin, end) of
+	// storage, clipped to the range, finding the first one once and then sweeping through them in order.
+	template<typename Func>
+	void ForEachStoredRun(int begin, int end, Func&& func) const
+	{
+		for (size_t run = FindRun(begin); begin < end; run++)
+		{
+			int runEnd = std::min((int)compressedBlockIds[run].end, end);
+			func(begin, runEnd - begin, compressedBlockIds[run].blockId);
+			begin = runEnd;
+		}
+	}
+
+private:
+	// Like CopyBlocks, but index and count are in storage order
+	void CopyStored(int index, int count, uint16_t* out) const;
+	uint32_t GetPaletteIndex(uint16_t block);
+	void ShrinkPalette();
+	size_t FindRun(int index) const;
+	void SetCompressedBlock(int index, uint16_t block);
+};
+
+struct ChunkBorders;
+
+// Copying a ChunkData is cheap, the copy shares its sections with the original.
+// Sections are copied on write, so a copy acts as a snapshot of the blocks at the time it was taken.
+struct ChunkData
+{
+	std::array<std::shared_ptr<ChunkSection>, CHUNK_SECTION_COUNT> sections;
 	bool compressed = false;
+	// Bumped whenever a block changes
+	uint32_t version = 0;
 
 	bool generated = false;
 
+	// Per column (x + z * CHUNK_WIDTH) bounds, kept up to date by Load and SetBlock.
+	// heightMap is the highest non-air block, -1 for an empty column.
+	// exposedMap is the lowest block that isn't solid, so everything below it is buried.
+	std::array<int16_t, CHUNK_WIDTH * CHUNK_WIDTH> heightMap;
+	std::array<int16_t, CHUNK_WIDTH * CHUNK_WIDTH> exposedMap;
+
 	ChunkData();
 	~ChunkData();
 
 	void Decompress();
 	void Compress();
 
+	// Replace the whole chunk with a flat array of CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_WIDTH block ids.
+	// Everything at or above height is air and isn't read.
+	void Load(const uint16_t* blockIDs, int height = CHUNK_HEIGHT);
+	size_t GetMemoryUsage() const;
+
+	// Returns true and sets block if every block in the section is the same.
+	bool IsSectionUniform(int section, uint16_t& block) const;
+
+	int GetHeight(int x, int z) const { return heightMap[x + z * CHUNK_WIDTH]; }
+	int GetLowestExposed(int x, int z) const { return exposedMap[x + z * CHUNK_WIDTH]; }
+	int GetMaxHeight() const;
+
+	// Bulk reads, each one works on contiguous memory and checks how sections are stored once per section.
+	void CopyBlocks(int index, int count, uint16_t* out) const;
+	void CopySlab(int y, uint16_t* out) const; // CHUNK_WIDTH * CHUNK_WIDTH blocks, x then z
+	void CopyRow(int y, int z, uint16_t* out) const; // CHUNK_WIDTH blocks along x
+	// The x = x or z = z plane for layers [minY, maxY), CHUNK_WIDTH blocks per layer along z or x
+	void CopyXSlab(int x, int minY, int maxY, uint16_t* out) const;
+	void CopyZSlab(int z, int minY, int maxY, uint16_t* out) const;
+
+	// Copies layers [minY, maxY) into out with a one block border all the way around, laid out as
+	// out[(y - minY + 1) * PADDED_CHUNK_WIDTH * PADDED_CHUNK_WIDTH + (z + 1) * PADDED_CHUNK_WIDTH + (x + 1)].
+	// The x and z borders come from borders and the y borders outside of the chunk are air.
+	// out needs (maxY - minY + 2) padded layers.
+	void CopyPadded(int minY, int maxY, uint16_t* out, const ChunkBorders& borders) const;
+
+	// Calls func(start, end, blockId) for every run of the same block in index order. Runs don't cross sections.
+	template<typename Func>
+	void ForEachRun(Func&& func) const
+	{
+		for (int i = 0; i < CHUNK_SECTION_COUNT; i++)
+		{
+			size_t runCount;
+			const CompressedBlockID* runs = sections[i]->GetRuns(runCount);
+			int start = i * CHUNK_SECTION_BLOCKS;
+			for (size_t run = 0; run < runCount; run++)
+			{
+				int end = i * CHUNK_SECTION_BLOCKS + runs[run].end;
+				func(start, end, runs[run].blockId);
+				start = end;
+			}
+		}
+	}
+
 	__forceinline static int GetIndex(int x, int y, int z);
 	__forceinline static int GetIndex(ChunkPos localBlockPos);
 
-	uint16_t GetBlock(ChunkPos blockPos);
-	uint16_t GetBlock(int x, int y, int z);
-	uint16_t GetBlock(int index);
+	uint16_t GetBlock(ChunkPos blockPos) const;
+	uint16_t GetBlock(int x, int y, int z) const;
+	uint16_t GetBlock(int index) const;
 	void SetBlock(ChunkPos pos, uint16_t block);
 	void SetBlock(int x, int y, int z, uint16_t block);
 	void SetBlock(int index, uint16_t block);
-};
\ No newline at end of file
+
+private:
+	// Returns section i for writing, copying it first if a snapshot still shares it
+	ChunkSection& EditSection(int i);
+	void UpdateColumnBounds(int column, int y, uint16_t block);
+};
+
+// The edges of the four neighbours that touch a chunk, copied out of them once per mesh job so
+// meshing never goes back to the neighbours. Each side holds layers [0, height) as
+// side[y * CHUNK_WIDTH + i], with i along the edge. Sides of missing neighbours are empty and read as air.
+struct ChunkBorders
+{
+	int height = 0;
+	std::vector<uint16_t> negX, posX, negZ, posZ;
+
+	void Extract(int height, const ChunkData* negXChunk, const ChunkData* posXChunk, const ChunkData* negZChunk, const ChunkData* posZChunk);
+};
@@ -9,7 +9,7 @@ namespace ChunkRenderer
 
 	void RenderOpaque(
 		std::unordered_map<ChunkPos, Chunk::Ptr, ChunkPosHash>& chunks,
-		Shader* solidShader, Shader* billboardShader,
+		Shader* solidShader, Shader* billboardShader, glm::vec3 cameraPos,
 		uint32_t& out_chunksLoading, uint32_t& out_chunksRendered)
 	{
 		ZoneScoped;
@@ -44,30 +44,29 @@ namespace ChunkRenderer
 
 			ShaderBinder _2(solidShader);
 
-			Planet::DrawingData& data = Planet::planet->opaqueDrawingData;
+			Planet::QuadData& data = Planet::planet->opaqueQuadData;
 
 			VAOBinder _3(data.vao);
-			BufferBinder _4(data.ebo);
+			BufferBinder _4(Planet::planet->quadIndices);
 			BufferBinder _5(Planet::planet->ibo);
+			data.quads.BindBase(0);
 
 			GLint modelLoc = solidShader->GetUniformLocation("models");
 			DrawElementsIndirectCommand commands[MAX_DRAW_COMMANDS];
 			glm::vec3 matrices[MAX_DRAW_COMMANDS];
 			int drawCount = 0;
-			for (auto& [chunkPos, chunk] : chunks)
-			{
-				if (!chunk->ready || !chunk->opaqueEle)
-					continue;
 
-				matrices[drawCount] = chunk->worldPos;
-				commands[drawCount].count = chunk->opaqueEle->size / sizeof(uint32_t);
+			// Four vertices per quad, the shader finds its quad from gl_VertexID
+			auto AddCommand = [&](const glm::vec3& worldPos, size_t firstQuad, size_t quadCount)
+			{
+				matrices[drawCount] = worldPos;
+				commands[drawCount].count = quadCount * 6;
 				commands[drawCount].instanceCount = 1;
-				commands[drawCount].firstIndex = chunk->opaqueEle->offset / sizeof(uint32_t);
-				commands[drawCount].baseVertex = chunk->opaqueTri->offset / sizeof(Vertex);
+				commands[drawCount].firstIndex = 0;
+				commands[drawCount].baseVertex = firstQuad * 4;
 				commands[drawCount].baseInstance = drawCount;
 
 				drawCount++;
-				out_chunksRendered++;
 
 				if (drawCount == MAX_DRAW_COMMANDS)
 				{
@@ -76,6 +75,70 @@ namespace ChunkRenderer
 					glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, drawCount, sizeof(DrawElementsIndirectCommand));
 					drawCount = 0;
 				}
+			};
+
+			for (auto& [chunkPos, chunk] : chunks)
+			{
+				if (!chunk->ready)
+					continue;
+
+				bool rendered = false;
+				for (int section = 0; section < CHUNK_SECTION_COUNT; section++)
+				{
+					Chunk::SectionMesh& mesh = chunk->sectionMeshes[section];
+					if (!mesh.opaqueMesh)
+						continue;
+
+					// The quads are sorted by direction (north, south, west, east, bottom, top). A direction is
+					// skipped when the camera is behind every plane the section's faces of it could be on, as
+					// then they all face away. Neighbouring directions that are both drawn share a command.
+					glm::vec3 sectionMin = chunk->worldPos + glm::vec3(0, section * CHUNK_SECTION_HEIGHT, 0);
+					glm::vec3 sectionMax = sectionMin + glm::vec3(CHUNK_WIDTH, CHUNK_SECTION_HEIGHT, CHUNK_WIDTH);
+					bool facing[6] = {
+						cameraPos.z < sectionMax.z, cameraPos.z > sectionMin.z,
+						cameraPos.x < sectionMax.x, cameraPos.x > sectionMin.x,
+						cameraPos.y < sectionMax.y, cameraPos.y > sectionMin.y,
+					};
+
+					size_t quad = mesh.opaqueMesh->offset / sizeof(PackedQuad);
+					size_t runStart = quad, runEnd = quad;
+					for (int direction = 0; direction < 6; direction++)
+					{
+						size_t count = mesh.opaqueDirectionQuads[direction];
+						if (facing[direction] && count)
+						{
+							if (runEnd != quad)
+							{
+								if (runEnd != runStart)
+									AddCommand(chunk->worldPos, runStart, runEnd - runStart);
+								runStart = quad;
+							}
+							runEnd = quad + count;
+						}
+						quad += count;
+					}
+					if (runEnd != runStart)
+					{
+						AddCommand(chunk->worldPos, runStart, runEnd - runStart);
+						rendered = true;
+					}
+				}
+
+				// Each border strip is a plane on one side of the chunk, facing out of it (left, right, front, back)
+				glm::vec3 chunkMax = chunk->worldPos + glm::vec3(CHUNK_WIDTH, 0, CHUNK_WIDTH);
+				bool borderFacing[4] = {
+					cameraPos.x < chunk->worldPos.x, cameraPos.x > chunkMax.x,
+					cameraPos.z < chunk->worldPos.z, cameraPos.z > chunkMax.z,
+				};
+				for (int side = 0; side < 4; side++)
+				{
+					GeoBuffer::Node* node = chunk->borderMeshes[side].opaqueMesh;
+					if (!node || !borderFacing[side])
+						continue;
+					AddCommand(chunk->worldPos, node->offset / sizeof(PackedQuad), node->size / sizeof(PackedQuad));
+					rendered = true;
+				}
+				out_chunksRendered += rendered;
 			}
 
 			if (drawCount != 0)
@@ -95,11 +158,12 @@ namespace ChunkRenderer
 
 			ShaderBinder _2(billboardShader);
 
-			Planet::DrawingData& data = Planet::planet->billboardDrawingData;
+			Planet::QuadData& data = Planet::planet->billboardQuadData;
 
 			VAOBinder _3(data.vao);
-			BufferBinder _4(data.ebo);
+			BufferBinder _4(Planet::planet->quadIndices);
 			BufferBinder _5(Planet::planet->ibo);
+			data.quads.BindBase(0);
 
 			GLint modelLoc = billboardShader->GetUniformLocation("models");
 			DrawElementsIndirectCommand commands[MAX_DRAW_COMMANDS];
@@ -107,24 +171,31 @@ namespace ChunkRenderer
 			int drawCount = 0;
 			for (auto& [chunkPos, chunk] : chunks)
 			{
-				if (!chunk->ready || !chunk->billboardEle)
+				if (!chunk->ready)
 					continue;
 
-				matrices[drawCount] = chunk->worldPos;
-				commands[drawCount].count = chunk->billboardEle->size / sizeof(uint32_t);
-				commands[drawCount].instanceCount = 1;
-				commands[drawCount].firstIndex = chunk->billboardEle->offset / sizeof(uint32_t);
-				commands[drawCount].baseVertex = chunk->billboardTri->offset / sizeof(BillboardVertex);
-				commands[drawCount].baseInstance = drawCount;
-
-				drawCount++;
-
-				if (drawCount == MAX_DRAW_COMMANDS)
+				for (Chunk::SectionMesh& mesh : chunk->sectionMeshes)
 				{
-					_2.setFloat3s(modelLoc, drawCount, matrices);
-					Planet::planet->ibo.SetData(sizeof(commands), commands, GL_DYNAMIC_DRAW);
-					glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, drawCount, sizeof(DrawElementsIndirectCommand));
-					drawCount = 0;
+					if (!mesh.billboardMesh)
+						continue;
+
+					// Two quads of four vertices per billboard
+					matrices[drawCount] = chunk->worldPos;
+					commands[drawCount].count = mesh.billboardMesh->size / sizeof(PackedBillboard) * 12;
+					commands[drawCount].instanceCount = 1;
+					commands[drawCount].firstIndex = 0;
+					commands[drawCount].baseVertex = mesh.billboardMesh->offset / sizeof(PackedBillboard) * 8;
+					commands[drawCount].baseInstance = drawCount;
+
+					drawCount++;
+
+					if (drawCount == MAX_DRAW_COMMANDS)
+					{
+						_2.setFloat3s(modelLoc, drawCount, matrices);
+						Planet::planet->ibo.SetData(sizeof(commands), commands, GL_DYNAMIC_DRAW);
+						glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, drawCount, sizeof(DrawElementsIndirectCommand));
+						drawCount = 0;
+					}
 				}
 			}
 
@@ -134,6 +205,8 @@ namespace ChunkRenderer
 				Planet::planet->ibo.SetData(sizeof(commands), commands, GL_DYNAMIC_DRAW);
 				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, drawCount, sizeof(DrawElementsIndirectCommand));
 			}
+
+			Buffer::ClearBind(GL_SHADER_STORAGE_BUFFER);
 		}
 	}
 
@@ -148,11 +221,12 @@ namespace ChunkRenderer
 		ScopedEnable _1(GL_BLEND);
 		ScopedEnable _2(GL_CULL_FACE, false);
 
-		Planet::DrawingData& data = Planet::planet->transparentDrawingData;
+		Planet::QuadData& data = Planet::planet->transparentQuadData;
 
 		VAOBinder _3(data.vao);
-		BufferBinder _4(data.ebo);
+		BufferBinder _4(Planet::planet->quadIndices);
 		BufferBinder _5(Planet::planet->ibo);
+		data.quads.BindBase(0);
 
 		GLint modelLoc = waterShader->GetUniformLocation("models");
 		DrawElementsIndirectCommand commands[MAX_DRAW_COMMANDS];
@@ -160,24 +234,36 @@ namespace ChunkRenderer
 		int drawCount = 0;
 		for (auto& [chunkPos, chunk] : chunks)
 		{
-			if (!chunk->ready || !chunk->waterEle)
+			if (!chunk->ready)
 				continue;
 
-			matrices[drawCount] = chunk->worldPos;
-			commands[drawCount].count = chunk->waterEle->size / sizeof(uint32_t);
-			commands[drawCount].instanceCount = 1;
-			commands[drawCount].firstIndex = chunk->waterEle->offset / sizeof(uint32_t);
-			commands[drawCount].baseVertex = chunk->waterTri->offset / sizeof(Vertex);
-			commands[drawCount].baseInstance = drawCount;
-
-			drawCount++;
+			GeoBuffer::Node* meshes[CHUNK_SECTION_COUNT + 4];
+			for (int i = 0; i < CHUNK_SECTION_COUNT; i++)
+				meshes[i] = chunk->sectionMeshes[i].waterMesh;
+			for (int side = 0; side < 4; side++)
+				meshes[CHUNK_SECTION_COUNT + side] = chunk->borderMeshes[side].waterMesh;
 
-			if (drawCount == MAX_DRAW_COMMANDS)
+			for (GeoBuffer::Node* mesh : meshes)
 			{
-				_.setFloat3s(modelLoc, drawCount, matrices);
-				Planet::planet->ibo.SetData(sizeof(commands), commands, GL_DYNAMIC_DRAW);
-				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, drawCount, sizeof(DrawElementsIndirectCommand));
-				drawCount = 0;
+				if (!mesh)
+					continue;
+
+				matrices[drawCount] = chunk->worldPos;
+				commands[drawCount].count = mesh->size / sizeof(PackedQuad) * 6;
+				commands[drawCount].instanceCount = 1;
+				commands[drawCount].firstIndex = 0;
+				commands[drawCount].baseVertex = mesh->offset / sizeof(PackedQuad) * 4;
+				commands[drawCount].baseInstance = drawCount;
+
+				drawCount++;
+
+				if (drawCount == MAX_DRAW_COMMANDS)
+				{
+					_.setFloat3s(modelLoc, drawCount, matrices);
+					Planet::planet->ibo.SetData(sizeof(commands), commands, GL_DYNAMIC_DRAW);
+					glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, drawCount, sizeof(DrawElementsIndirectCommand));
+					drawCount = 0;
+				}
 			}
 		}
 
@@ -187,5 +273,7 @@ namespace ChunkRenderer
 			Planet::planet->ibo.SetData(sizeof(commands), commands, GL_DYNAMIC_DRAW);
 			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, drawCount, sizeof(DrawElementsIndirectCommand));
 		}
+
+		Buffer::ClearBind(GL_SHADER_STORAGE_BUFFER);
 	}
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
 #include <iostream>
 
 #include <tracy/Tracy.hpp>
@@ -15,9 +16,13 @@
 
 #include "WorldGen.h"
 #include "ChunkRenderer.h"
+#include "utils/SlabPool.h"
 
 #define SYNCRONOUS_GENERATION 0
 
+static constexpr double COMPRESSION_UPDATE_INTERVAL = 0.25;
+static constexpr int MAX_COMPRESSIONS_PER_UPDATE = 32;
+
 Planet* Planet::planet = nullptr;
 
 //static const unsigned int CHUNK_SIZE = 32;
@@ -33,44 +38,11 @@ Planet::Planet(Shader* solidShader, Shader* waterShader, Shader* billboardShader
 		generatorThreads.emplace_back(&Planet::ChunkThreadGenerator, this, i);
 #endif
 
-	{
-		DrawingData& data = opaqueDrawingData;
-		data.vbo.Resize(16 * 1024 * 1024 * sizeof(Vertex), GL_DYNAMIC_DRAW);
-		data.ebo.Resize(16 * 1024 * 1024 * sizeof(uint32_t), GL_DYNAMIC_DRAW);
-
-		data.vao.BindVertexBuffer(0, data.vbo, 0, sizeof(Vertex));
-		data.vao.BindVertexBuffer(1, data.vbo, 0, sizeof(Vertex));
-		data.vao.BindVertexBuffer(2, data.vbo, 0, sizeof(Vertex));
-		data.vao.SetAttribPointerI(0, 3, GL_BYTE, offsetof(Vertex, pos));
-		data.vao.SetAttribPointerI(1, 2, GL_BYTE, offsetof(Vertex, texGrid));
-		data.vao.SetAttribPointerI(2, 1, GL_BYTE, offsetof(Vertex, direction));
-	}
+	opaqueQuadData.quads.Resize(4 * 1024 * 1024 * sizeof(PackedQuad), GL_DYNAMIC_DRAW);
+	billboardQuadData.quads.Resize(4 * 1024 * 1024 * sizeof(PackedBillboard), GL_DYNAMIC_DRAW);
 
-	{
-		DrawingData& data = billboardDrawingData;
-		data.vbo.Resize(16 * 1024 * 1024 * sizeof(BillboardVertex), GL_DYNAMIC_DRAW);
-		data.ebo.Resize(16 * 1024 * 1024 * sizeof(uint32_t), GL_DYNAMIC_DRAW);
-
-		data.vao.BindVertexBuffer(0, data.vbo, 0, sizeof(BillboardVertex));
-		data.vao.BindVertexBuffer(1, data.vbo, 0, sizeof(BillboardVertex));
-		data.vao.BindVertexBuffer(2, data.vbo, 0, sizeof(BillboardVertex));
-		data.vao.SetAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, offsetof(BillboardVertex, pos));
-		data.vao.SetAttribPointerI(1, 2, GL_BYTE, offsetof(BillboardVertex, texGrid));
-		data.vao.SetAttribPointerI(2, 1, GL_BYTE, offsetof(BillboardVertex, direction));
-	}
-
-	{
-		DrawingData& data = transparentDrawingData;
-		data.vbo.Resize(16 * 1024 * 1024 * sizeof(Vertex), GL_DYNAMIC_DRAW);
-		data.ebo.Resize(16 * 1024 * 1024 * sizeof(uint32_t), GL_DYNAMIC_DRAW);
-
-		data.vao.BindVertexBuffer(0, data.vbo, 0, sizeof(Vertex));
-		data.vao.BindVertexBuffer(1, data.vbo, 0, sizeof(Vertex));
-		data.vao.BindVertexBuffer(2, data.vbo, 0, sizeof(Vertex));
-		data.vao.SetAttribPointerI(0, 3, GL_BYTE, offsetof(Vertex, pos));
-		data.vao.SetAttribPointerI(1, 2, GL_BYTE, offsetof(Vertex, texGrid));
-		data.vao.SetAttribPointerI(2, 1, GL_BYTE, offsetof(Vertex, direction));
-	}
+	transparentQuadData.quads.Resize(1024 * 1024 * sizeof(PackedQuad), GL_DYNAMIC_DRAW);
+	ReserveQuadIndices(64 * 1024);
 
 	chunkComputeShader.ComputeShader("assets/shaders/chunk_compute.glsl");
 	chunkComputeShader.Compile();
@@ -97,7 +69,7 @@ void Planet::Update(glm::vec3 cameraPos)
 		//glLineWidth(3);
 
 		numChunks = chunks.size();
-		ChunkRenderer::RenderOpaque(chunks, solidShader, billboardShader, chunksLoading, numChunksRendered);
+		ChunkRenderer::RenderOpaque(chunks, solidShader, billboardShader, cameraPos, chunksLoading, numChunksRendered);
 		ChunkRenderer::RenderTransparent(chunks, waterShader);
 	}
 
@@ -155,11 +127,89 @@ void Planet::Update(glm::vec3 cameraPos)
 		}
 	}
 
+	UpdateCompression();
+	SlabPool::Get().PlotStats();
+
 #if SYNCRONOUS_GENERATION
 	ChunkThreadGenerator(-1);
 #endif
 }
 
+void Planet::UpdateCompression()
+{
+	double now = glfwGetTime();
+	if (now - lastCompressionUpdate < COMPRESSION_UPDATE_INTERVAL)
+		return;
+	lastCompressionUpdate = now;
+
+	ZoneScoped;
+
+	struct Candidate
+	{
+		float dist;
+		bool cold;
+		Chunk::Ptr chunk;
+	};
+	std::vector<Candidate> candidates;
+
+	chunkMemoryUsage = 0;
+	compressedMemoryUsage = 0;
+	compressedSourceMemoryUsage = 0;
+	numChunksCompressed = 0;
+	for (auto& [pos, chunk] : chunks)
+	{
+		if (!chunk->chunkData.generated)
+			continue;
+
+		chunkMemoryUsage += chunk->memoryUsage;
+		if (chunk->chunkData.compressed)
+		{
+			numChunksCompressed++;
+			compressedMemoryUsage += chunk->memoryUsage;
+			compressedSourceMemoryUsage += chunk->uncompressedMemoryUsage;
+			continue;
+		}
+
+		float dist = sqrt(pow(abs(pos.x - camChunkX), 2) + pow(abs(pos.z - camChunkZ), 2));
+		if (dist <= compressDistance)
+			continue;
+
+		candidates.push_back({ dist, now - chunk->lastTouched > compressAfter, chunk });
+	}
+
+	if (!compressChunks)
+		return;
+
+	// Furthest first, so going over the budget gives up the chunks least likely to be needed again
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.dist > b.dist; });
+
+	size_t budget = (size_t)memoryBudgetMB * 1024 * 1024;
+	int compressions = 0;
+	for (Candidate& candidate : candidates)
+	{
+		if (compressions == MAX_COMPRESSIONS_PER_UPDATE)
+			break;
+		if (!candidate.cold && chunkMemoryUsage <= budget)
+			continue;
+
+		Chunk::Ptr& chunk = candidate.chunk;
+		std::unique_lock lock(chunk->dataMutex, std::try_to_lock);
+		if (!lock)
+			continue;
+
+		size_t before = chunk->memoryUsage;
+		chunk->chunkData.Compress();
+		chunk->uncompressedMemoryUsage = before;
+		chunk->memoryUsage = chunk->chunkData.GetMemoryUsage();
+
+		chunkMemoryUsage -= before - chunk->memoryUsage;
+		compressedMemoryUsage += chunk->memoryUsage;
+		compressedSourceMemoryUsage += before;
+		numChunksCompressed++;
+		compressions++;
+	}
+}
+
 void Planet::ChunkThreadGenerator(int threadId)
 {
 	using namespace std::chrono_literals;
@@ -173,12 +223,39 @@ void Planet::ChunkThreadGenerator(int threadId)
 	while (!shouldEnd)
 	{
 #endif
+		// Sections of a chunk another thread is meshing come first, that thread is waiting on them
+		if (RunSubtask())
+			continue;
+
+		// Chunks waiting for their neighbours are looked at again when there's nothing else to do, and every
+		// DEFERRED_CHECK_INTERVAL chunks otherwise so ones whose wait has run out aren't held up behind a busy queue
 		Chunk::Ptr chunk;
-		if (generatorChunks.try_dequeue(chunk))
+		bool retrying = ++dequeues % DEFERRED_CHECK_INTERVAL == 0 && deferredChunks.try_dequeue(chunk);
+		bool idle = false;
+		if (!retrying && !urgentChunks.try_dequeue(chunk) && !generatorChunks.try_dequeue(chunk))
+			idle = retrying = deferredChunks.try_dequeue(chunk);
+		if (chunk)
 		{
 			ZoneScoped;
 
+			if (retrying)
+				chunk->deferred = false;
+
 			std::array<Chunk::Ptr, 4> surroundingChunks;
+			bool urgent = false;
+
+			// The neighbours only remesh their border strip along this chunk, which is on their opposite side
+			auto QueueEdgeNeighbours = [&](uint32_t edgeSides)
+				{
+					if (surroundingChunks[0] && edgeSides & 1)
+						AddChunkToGenerate(surroundingChunks[0], Chunk::BorderBit(1), urgent);
+					if (surroundingChunks[1] && edgeSides & 2)
+						AddChunkToGenerate(surroundingChunks[1], Chunk::BorderBit(0), urgent);
+					if (surroundingChunks[2] && edgeSides & 4)
+						AddChunkToGenerate(surroundingChunks[2], Chunk::BorderBit(3), urgent);
+					if (surroundingChunks[3] && edgeSides & 8)
+						AddChunkToGenerate(surroundingChunks[3], Chunk::BorderBit(2), urgent);
+				};
 
 			{
 				ZoneScopedN("Checks");
@@ -186,10 +263,14 @@ void Planet::ChunkThreadGenerator(int threadId)
 				{
 					continue;
 				}
-				if (!chunk->generatorMutex.try_lock())
+				// Whoever is meshing the chunk now will see remesh and queue it again
+				chunk->remesh = true;
+				if (chunk->meshing.exchange(true))
 				{
 					continue;
 				}
+				chunk->remesh = false;
+				urgent = chunk->urgent.exchange(false);
 
 				auto getChunk = [this](Chunk::Ptr base, int x, int y, int z)->Chunk::Ptr
 					{
@@ -207,17 +288,19 @@ void Planet::ChunkThreadGenerator(int threadId)
 				{
 					getChunk(chunk, -1, 0,  0), // left
 					getChunk(chunk, 1, 0,  0),  // right
-					getChunk(chunk, 0, 0, 1),   // front
-					getChunk(chunk, 0, 0, -1),  // back
+					getChunk(chunk, 0, 0, -1),  // front
+					getChunk(chunk, 0, 0, 1),   // back
 				};
 
+				// A job that was running when an edit came in sets generated over the edit's reset, so the dirty
+				// sections decide whether there's anything left to mesh
 				if ((chunk->surroundedChunks[0] == (bool)surroundingChunks[0]
 					&& chunk->surroundedChunks[1] == (bool)surroundingChunks[1]
 					&& chunk->surroundedChunks[2] == (bool)surroundingChunks[2]
 					&& chunk->surroundedChunks[3] == (bool)surroundingChunks[3])
-					&& chunk->generated)
+					&& chunk->generated && chunk->dirtySections == 0)
 				{
-					chunk->generatorMutex.unlock();
+					FinishMeshing(chunk);
 					continue;
 				}
 			}
@@ -227,60 +310,166 @@ void Planet::ChunkThreadGenerator(int threadId)
 			// Generate blocks using noisemaps
 			if (!chunk->chunkData.generated)
 			{
-				chunk->chunkData.blockIDs = new uint16_t[CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_WIDTH];
+				std::unique_lock lock(chunk->dataMutex);
 				WorldGen::GenerateChunkData(chunk->chunkPos, &chunk->chunkData);
-				chunk->edgeUpdate = true;
+				chunk->memoryUsage = chunk->chunkData.GetMemoryUsage();
+				chunk->edgeSides = 0xF; // All four sides
+				chunk->dataTime = glfwGetTime();
+				chunk->Touch();
+			}
+
+			// The first mesh waits until all four neighbours have blocks, or for neighbourTimeout seconds after this
+			// chunk got its blocks, so it's meshed once rather than again as each neighbour arrives. The neighbours
+			// still hear about this chunk's blocks, the ones waiting as well check again then.
+			bool surrounded = surroundingChunks[0] && surroundingChunks[1] && surroundingChunks[2] && surroundingChunks[3];
+			if (waitForNeighbours && !surrounded && chunk->meshCount == 0 && glfwGetTime() - chunk->dataTime < neighbourTimeout)
+			{
+				QueueEdgeNeighbours(chunk->edgeSides.exchange(0));
+				if (!chunk->deferred.exchange(true))
+					deferredChunks.enqueue(chunk);
+				FinishMeshing(chunk);
+#if !SYNCRONOUS_GENERATION
+				// Nothing else was queued, don't spin on the chunks that are waiting
+				if (idle)
+					Sleep(1);
+#endif
+				continue;
 			}
 
 			// Convert blocks to triangle mesh
 
-			bool firstTime = !chunk->generated;
+			// Edits only remesh the sections they touched, a neighbour arriving or going only changes the border strip
+			// along it. The dirty sections are taken before the snapshot, so edits made after it are meshed again next time.
+			uint32_t meshes = chunk->dirtySections.exchange(0);
+			for (int i = 0; i < 4; i++)
+				if (chunk->surroundedChunks[i] != (surroundingChunks[i] != nullptr))
+					meshes |= Chunk::BorderBit(i);
 
 			chunk->surroundedChunks[0] = surroundingChunks[0] != nullptr;
 			chunk->surroundedChunks[1] = surroundingChunks[1] != nullptr;
 			chunk->surroundedChunks[2] = surroundingChunks[2] != nullptr;
 			chunk->surroundedChunks[3] = surroundingChunks[3] != nullptr;
-			//chunkMeshMutex.lock();
-			chunk->GenerateChunkMesh(surroundingChunks[0], surroundingChunks[1], surroundingChunks[2], surroundingChunks[3]);
-			//chunkMeshMutex.unlock();
-
-			if (chunk->edgeUpdate)
 			{
-				if (surroundingChunks[0])
-					AddChunkToGenerate(surroundingChunks[0]);
-				if (surroundingChunks[1])
-					AddChunkToGenerate(surroundingChunks[1]);
-				if (surroundingChunks[2])
-					AddChunkToGenerate(surroundingChunks[2]);
-				if (surroundingChunks[3])
-					AddChunkToGenerate(surroundingChunks[3]);
+				// The snapshots stay valid however the chunks are edited, compressed or unloaded meanwhile.
+				// The chunk and its neighbours can be compressed, meshing reads them in place rather than decompressing them,
+				// and doesn't count as using the chunk so a cold chunk stays compressed.
+				std::shared_ptr<const ChunkData> snapshot = chunk->GetSnapshot();
+				// Only the border strips read the neighbours
+				std::array<std::shared_ptr<const ChunkData>, 4> neighbourSnapshots;
+				for (int i = 0; i < 4; i++)
+					if (surroundingChunks[i] && meshes & Chunk::BorderBit(i))
+						neighbourSnapshots[i] = surroundingChunks[i]->GetSnapshot();
+
+				//chunkMeshMutex.lock();
+				chunk->GenerateChunkMesh(*snapshot, neighbourSnapshots[0].get(), neighbourSnapshots[1].get(), neighbourSnapshots[2].get(), neighbourSnapshots[3].get(), meshes);
+				//chunkMeshMutex.unlock();
 			}
+
+			meshJobs++;
+			if (!(meshes & Chunk::ALL_SECTIONS))
+				borderMeshJobs++;
+			if (chunk->meshCount++ == 0)
+				meshedChunks++;
+
+			if (uint32_t edgeSides = chunk->edgeSides.exchange(0))
+				QueueEdgeNeighbours(edgeSides);
 			else
 			{
 				if (surroundingChunks[0] && !surroundingChunks[0]->surroundedChunks[1])
-					AddChunkToGenerate(surroundingChunks[0]);
+					AddChunkToGenerate(surroundingChunks[0], Chunk::BorderBit(1));
 				if (surroundingChunks[1] && !surroundingChunks[1]->surroundedChunks[0])
-					AddChunkToGenerate(surroundingChunks[1]);
+					AddChunkToGenerate(surroundingChunks[1], Chunk::BorderBit(0));
 				if (surroundingChunks[2] && !surroundingChunks[2]->surroundedChunks[3])
-					AddChunkToGenerate(surroundingChunks[2]);
+					AddChunkToGenerate(surroundingChunks[2], Chunk::BorderBit(3));
 				if (surroundingChunks[3] && !surroundingChunks[3]->surroundedChunks[2])
-					AddChunkToGenerate(surroundingChunks[3]);
+					AddChunkToGenerate(surroundingChunks[3], Chunk::BorderBit(2));
 			}
 
-			chunk->edgeUpdate = false;
-			chunk->generatorMutex.unlock();
+			FinishMeshing(chunk);
+			continue;
 		}
 
 #if !SYNCRONOUS_GENERATION
+		// Only idle threads sleep, so queued work and other threads' sections get picked up right away
 		Sleep(1);
 	}
 #endif
 }
 
-void Planet::AddChunkToGenerate(Chunk::Ptr chunk)
+void Planet::FinishMeshing(Chunk::Ptr chunk)
+{
+	chunk->meshing = false;
+	// The sections to remesh were marked when the request came in
+	if (chunk->remesh.exchange(false))
+		AddChunkToGenerate(chunk, 0, chunk->urgent);
+}
+
+void Planet::RunParallel(int count, const std::function<void(int)>& task)
+{
+	if (count <= 1)
+	{
+		if (count)
+			task(0);
+		return;
+	}
+
+	ZoneScoped;
+	std::atomic<int> remaining = count;
+	for (int i = 1; i < count; i++)
+		subtasks.enqueue([&task, &remaining, i]() { task(i); remaining--; });
+
+	// Take the first one and then help out, with other threads' subtasks as well, until the last of ours is done
+	task(0);
+	while (remaining > 1)
+		if (!RunSubtask())
+			std::this_thread::yield();
+}
+
+bool Planet::RunSubtask()
 {
+	std::function<void()> subtask;
+	if (!subtasks.try_dequeue(subtask))
+		return false;
+	subtask();
+	return true;
+}
+
+void Planet::RemeshChunks()
+{
+	for (auto& [pos, chunk] : chunks)
+		if (chunk->chunkData.generated)
+			AddChunkToGenerate(chunk);
+}
+
+void Planet::ReserveQuadIndices(size_t quads)
+{
+	if (quads <= quadIndexCapacity)
+		return;
+
+	ZoneScoped;
+	quadIndexCapacity = std::max(quads, quadIndexCapacity * 2);
+
+	// Two triangles per quad, the same order the quads' corners are in
+	static constexpr uint32_t pattern[6] = { 0, 3, 1, 0, 2, 3 };
+	std::vector<uint32_t> indices(quadIndexCapacity * 6);
+	for (size_t i = 0; i < indices.size(); i++)
+		indices[i] = i / 6 * 4 + pattern[i % 6];
+	quadIndices.SetData(indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+}
+
+void Planet::AddChunkToGenerate(Chunk::Ptr chunk, uint32_t meshes, bool urgent)
+{
+	chunk->dirtySections |= meshes;
 	chunk->generated = false;
-	generatorChunks.enqueue(chunk);
+	if (urgent)
+	{
+		chunk->urgent = true;
+		urgentChunks.enqueue(chunk);
+	}
+	else
+	{
+		generatorChunks.enqueue(chunk);
+	}
 }
 
 void Planet::AddChunkToGenerate(ChunkPos chunkPos)
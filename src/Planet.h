@@ -5,6 +5,7 @@
 #include <string>
 #include <queue>
 #include <thread>
+#include <functional>
 #include <mutex>
 #include <shared_mutex>
 #include <glm/glm.hpp>
@@ -15,24 +16,23 @@
 #include "Chunk.h"
 #include "ChunkPosHash.h"
 
-constexpr unsigned int CHUNK_WIDTH = 32; // x/z
-constexpr unsigned int CHUNK_HEIGHT = 512; // y
-
 class Planet
 {
 // Methods
 public:
-	struct DrawingData
+	// Meshes of PackedQuads or PackedBillboards, which the shaders read from the storage buffer rather than through vertex attributes
+	struct QuadData
 	{
-		VertexArrayObject vao;
-		GeoBuffer vbo = GeoBuffer(GL_ARRAY_BUFFER);
-		GeoBuffer ebo = GeoBuffer(GL_ELEMENT_ARRAY_BUFFER);
+		VertexArrayObject vao; // Has no attributes, but drawing needs one bound
+		GeoBuffer quads = GeoBuffer(GL_SHADER_STORAGE_BUFFER);
 	};
 
 	Planet(Shader* solidShader, Shader* waterShader, Shader* billboardShader);
 	~Planet();
 
-	void AddChunkToGenerate(Chunk::Ptr chunk);
+	// Queues the chunk to be meshed, remeshing the given sections and border strips. Urgent chunks, like ones
+	// the player edited, are taken before any others.
+	void AddChunkToGenerate(Chunk::Ptr chunk, uint32_t meshes = Chunk::ALL_MESHES, bool urgent = false);
 	void AddChunkToGenerate(ChunkPos chunkPos);
 	void Update(glm::vec3 cameraPos);
 
@@ -45,9 +45,21 @@ public:
 	{
 		lastCamX++;
 	}
+	// Queues every loaded chunk to be meshed again, e.g. after a meshing setting changes
+	void RemeshChunks();
+	// Grows quadIndices to cover meshes of up to this many quads
+	void ReserveQuadIndices(size_t quads);
+	// Runs task(0) to task(count - 1) on whichever generator threads are free and returns once they're all
+	// done. The calling thread works on them as well, so it never just waits.
+	void RunParallel(int count, const std::function<void(int)>& task);
 
 private:
 	void ChunkThreadGenerator(int threadId);
+	// Releases a chunk a generator thread was meshing, queueing it again if that was asked for meanwhile
+	void FinishMeshing(Chunk::Ptr chunk);
+	void UpdateCompression();
+	// Runs one of the tasks RunParallel queued, returns false if there weren't any
+	bool RunSubtask();
 
 // Variables
 public:
@@ -58,14 +70,35 @@ public:
 	int clearChunkQueue = 0;
 	bool deleteChunks = true;
 	bool loadChunks = true;
+	// Merge neighbouring faces with the same texture into larger quads
+	bool greedyMeshing = true;
+	// Hold back a chunk's first mesh until all four neighbours have blocks, for up to neighbourTimeout seconds
+	bool waitForNeighbours = true;
+	float neighbourTimeout = 1.0f;
+	// Mesh jobs run, the ones that only remeshed border strips, and chunks meshed at least once
+	std::atomic<size_t> meshJobs = 0, borderMeshJobs = 0, meshedChunks = 0;
+
+	// Chunks further than compressDistance that haven't been touched for compressAfter seconds get
+	// compressed, and once chunk memory goes over the budget the furthest chunks are compressed early.
+	bool compressChunks = true;
+	float compressAfter = 10.0f;
+	int compressDistance = 4;
+	int memoryBudgetMB = 2048;
+	size_t chunkMemoryUsage = 0;
+	size_t compressedMemoryUsage = 0, compressedSourceMemoryUsage = 0;
+	unsigned int numChunksCompressed = 0;
 
 	std::mutex chunkMutex;
 
-	DrawingData opaqueDrawingData;
-	DrawingData billboardDrawingData;
-	DrawingData transparentDrawingData;
+	QuadData opaqueQuadData;
+	QuadData billboardQuadData;
+	QuadData transparentQuadData;
 	Buffer modelsSSBO = Buffer(GL_SHADER_STORAGE_BUFFER);
 	Buffer ibo = Buffer(GL_DRAW_INDIRECT_BUFFER);
+	// Every mesh is made of quads with the same four vertex pattern, so they all share one index buffer
+	// and only store their vertices. A draw's baseVertex says where its mesh starts.
+	Buffer quadIndices = Buffer(GL_ELEMENT_ARRAY_BUFFER);
+	size_t quadIndexCapacity = 0;
 
 	Shader chunkComputeShader;
 
@@ -78,6 +111,7 @@ private:
 	std::queue<ChunkPos> chunkDataDeleteQueue;
 	unsigned int chunksLoading = 0;
 	int lastCamX = -100, lastCamY = -100, lastCamZ = -100;
+	double lastCompressionUpdate = 0;
 
 	Shader* solidShader;
 	Shader* waterShader;
@@ -85,6 +119,13 @@ private:
 
 	std::vector<std::thread> generatorThreads;
 	moodycamel::ConcurrentQueue<Chunk::Ptr> generatorChunks;
+	moodycamel::ConcurrentQueue<Chunk::Ptr> urgentChunks;
+	// Chunks whose first mesh is waiting for their neighbours, one is checked every DEFERRED_CHECK_INTERVAL dequeues
+	moodycamel::ConcurrentQueue<Chunk::Ptr> deferredChunks;
+	static constexpr uint32_t DEFERRED_CHECK_INTERVAL = 8;
+	std::atomic<uint32_t> dequeues = 0;
+	// Pieces of jobs another thread is waiting on, taken before any new chunk
+	moodycamel::ConcurrentQueue<std::function<void()>> subtasks;
 
 	bool shouldEnd = false;
 };
\ No newline at end of file
@@ -1,29 +1,38 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <cstdint>
 
-struct Vertex
+// One quad of the opaque or water mesh. The vertex shaders read these from a storage buffer and build the
+// quad's four corners from gl_VertexID, so there are no per vertex records.
+// position: x (5 bits), y (9), z (5), face (3), width - 1 (5), height - 1 (5)
+// texture: atlas tile x (8 bits), tile y (8)
+struct PackedQuad
 {
-	glm::i8vec3 pos;
-	glm::i8vec2 texGrid;
-	char direction;
+	uint32_t position;
+	uint32_t texture;
 
-	Vertex(glm::i8vec3 _pos, glm::i8vec2 _texGrid, char _direction = 0)
-		: pos(_pos), texGrid(_texGrid), direction(_direction)
+	// Face 7 isn't a direction, it marks a free slot in a mesh and the shaders draw nothing for it
+	static constexpr int EMPTY_FACE = 7;
+
+	PackedQuad() = default;
+	PackedQuad(int x, int y, int z, int face, int width, int height, glm::i8vec2 tile)
+		: position(x | y << 5 | z << 14 | face << 19 | (width - 1) << 22 | (uint32_t)(height - 1) << 27),
+		texture((uint8_t)tile.x | (uint8_t)tile.y << 8)
 	{ }
+
+	static PackedQuad Empty() { return PackedQuad(0, 0, 0, EMPTY_FACE, 1, 1, { 0, 0 }); }
 };
 
-struct BillboardVertex
+// One billboard block. The billboard vertex shader expands it into two quads crossed along the block's
+// diagonals, drawn as eight indexed vertices, and takes the tile's far corner as one tile past the near one.
+// x (5 bits), y (9), z (5), atlas tile x (6), tile y (6)
+struct PackedBillboard
 {
-	glm::u16vec3 pos;
-	glm::i8vec2 texGrid;
-	char direction;
+	uint32_t data;
 
-	BillboardVertex(glm::lowp_fvec3 _pos, glm::i8vec2 _texGrid, char _direction = 0)
-		: texGrid(_texGrid), direction(_direction)
-	{
-		pos.x = glm::detail::toFloat16(_pos.x);
-		pos.y = glm::detail::toFloat16(_pos.y);
-		pos.z = glm::detail::toFloat16(_pos.z);
-	}
+	PackedBillboard() = default;
+	PackedBillboard(int x, int y, int z, glm::i8vec2 tile)
+		: data(x | y << 5 | z << 14 | (tile.x & 63) << 19 | (uint32_t)(tile.y & 63) << 25)
+	{ }
 };
@@ -289,6 +289,12 @@ void WorldGen::GenerateChunkData(ChunkPos chunkPos, ChunkData* chunkData)
 
 	static int waterLevel = 64;
 
+	// Generated into a flat array first, ChunkData packs it into its sections afterwards.
+	// Only blocks below dirtyHeight can be left over from the previous chunk on this thread.
+	static thread_local std::vector<uint16_t> blockIDs(CHUNK_WIDTH * CHUNK_HEIGHT * CHUNK_WIDTH);
+	static thread_local int dirtyHeight = 0;
+	int height = 0;
+
 	// Account for chunk position
 	int startX = chunkPos.x * CHUNK_WIDTH;
 	int startY = chunkPos.y * CHUNK_HEIGHT;
@@ -309,7 +315,14 @@ void WorldGen::GenerateChunkData(ChunkPos chunkPos, ChunkData* chunkData)
 					* surfaceSettings[i].amplitude;
 			}
 
-			for (int y = 0; y < CHUNK_HEIGHT; y++)
+			// Nothing but air above the surface and the water line
+			int columnHeight = std::clamp(std::max(noiseY, waterLevel) - startY + 1, 0, (int)CHUNK_HEIGHT);
+			height = std::max(height, columnHeight);
+
+			for (int y = columnHeight; y < dirtyHeight; y++)
+				blockIDs[(y * CHUNK_WIDTH * CHUNK_WIDTH) + (x) + (z * CHUNK_WIDTH)] = Blocks::AIR;
+
+			for (int y = 0; y < columnHeight; y++)
 			{
 				// Cave noise
 				bool cave = false;
@@ -339,12 +352,12 @@ void WorldGen::GenerateChunkData(ChunkPos chunkPos, ChunkData* chunkData)
 				if (y + startY > noiseY)
 				{
 					if (y + startY <= waterLevel)
-						chunkData->blockIDs[localIndex] = Blocks::WATER;
+						blockIDs[localIndex] = Blocks::WATER;
 					else
-						chunkData->blockIDs[localIndex] = Blocks::AIR;
+						blockIDs[localIndex] = Blocks::AIR;
 				}
 				else if (cave)
-					chunkData->blockIDs[localIndex] = Blocks::AIR;
+					blockIDs[localIndex] = Blocks::AIR;
 				// Ground
 				else
 				{
@@ -362,7 +375,7 @@ void WorldGen::GenerateChunkData(ChunkPos chunkPos, ChunkData* chunkData)
 
 						if (noiseOre > oreSettings[i].chance)
 						{
-							chunkData->blockIDs[localIndex] = oreSettings[i].block;
+							blockIDs[localIndex] = oreSettings[i].block;
 							blockSet = true;
 							break;
 						}
@@ -372,16 +385,16 @@ void WorldGen::GenerateChunkData(ChunkPos chunkPos, ChunkData* chunkData)
 					{
 						if (y + startY == noiseY)
 							if (noiseY > waterLevel + 1)
-								chunkData->blockIDs[localIndex] = Blocks::GRASS_BLOCK;
+								blockIDs[localIndex] = Blocks::GRASS_BLOCK;
 							else
-								chunkData->blockIDs[localIndex] = Blocks::SAND;
+								blockIDs[localIndex] = Blocks::SAND;
 						else if (y + startY > waterLevel - 10)
 							if (noiseY > waterLevel + 1)
-								chunkData->blockIDs[localIndex] = Blocks::DIRT_BLOCK;
+								blockIDs[localIndex] = Blocks::DIRT_BLOCK;
 							else
-								chunkData->blockIDs[localIndex] = Blocks::SAND;
+								blockIDs[localIndex] = Blocks::SAND;
 						else
-							chunkData->blockIDs[localIndex] = Blocks::STONE_BLOCK;
+							blockIDs[localIndex] = Blocks::STONE_BLOCK;
 					}
 				}
 
@@ -474,8 +487,11 @@ void WorldGen::GenerateChunkData(ChunkPos chunkPos, ChunkData* chunkData)
 								//int localIndex = localX * CHUNK_WIDTH * CHUNK_WIDTH + localZ * CHUNK_HEIGHT + localY;
 								//std::cout << "Local Index: " << localIndex << ", Max Index: " << chunkData->blockIDs->size() << '\n';
 
-								if (surfaceFeatures[i].replaceBlock[featureIndex] || chunkData->blockIDs[localIndex] == 0)
-									chunkData->blockIDs[localIndex] = surfaceFeatures[i].blocks[featureIndex];
+								if (surfaceFeatures[i].replaceBlock[featureIndex] || blockIDs[localIndex] == 0)
+								{
+									blockIDs[localIndex] = surfaceFeatures[i].blocks[featureIndex];
+									height = std::max(height, localY + 1);
+								}
 							}
 						}
 					}
@@ -484,48 +500,7 @@ void WorldGen::GenerateChunkData(ChunkPos chunkPos, ChunkData* chunkData)
 		}
 	}
 
-	//std::vector<uint16_t> pallet;
-	//for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE; i++)
-	//{
-	//	if (std::find(pallet.begin(), pallet.end(), chunkData->blockIDs[i]) == pallet.end())
-	//		pallet.emplace_back(chunkData->blockIDs[i]);
-	//}
-
-	//chunkData->pallet = new uint16_t[pallet.size()];
-	//for (int i = 0; i < pallet.size(); i++)
-	//	chunkData->pallet[i] = pallet[i];
-
-	//int palletBitcount = 1, i;
-	//if (pallet.size() > 1)
-	//{
-	//	for (i = 0; i < 32; i++)
-	//	{
-	//		if ((1 << i) & pallet.size())
-	//			palletBitcount = i + 1;
-	//	}
-	//}
-
-	//chunkData->blockIdxs = Bitset(CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE * palletBitcount);
-
-	////int amountOfBytes = ceilf((float)(CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE) / 8 * pallet.size());
-	////amountOfBytes = (amountOfBytes + (amountOfBytes % 2)) + 1; // pad it to uint16
-	////chunkData->blockIdxs = new uint8_t[amountOfBytes];
-	//for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE; i++)
-	//{
-	//	int idx = -1;
-	//	for (int j = 0; j < pallet.size(); j++)
-	//	{
-	//		if (chunkData->blockIDs[i] == pallet[j])
-	//		{
-	//			idx = j;
-	//			break;
-	//		}
-	//	}
-
-	//	assert(idx != -1 && "Failed to find block in pallet??");
-
-	//	chunkData->blockIdxs.Set(idx + 1, (size_t)(i * palletBitcount), palletBitcount);
-	//}
-
+	chunkData->Load(blockIDs.data(), height);
+	dirtyHeight = height;
 	chunkData->generated = true;
 }
\ No newline at end of file
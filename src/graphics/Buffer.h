@@ -149,6 +149,13 @@ public:
 		return node;
 	}
 
+	// Overwrites part of a node's data, offset is from the start of the node
+	void UpdateData(Node* node, size_t offset, size_t size, const void* data)
+	{
+		assert(offset + size <= node->size && "Updated past the end of the node");
+		glNamedBufferSubData(m_id, node->offset + offset, size, data);
+	}
+
 	void RemoveData(Node* node)
 	{
 		if (!node)
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SlabPool.h"
+
+// Fixed size array of unsigned integers, each stored in `bits` bits.
+// Only power of two widths (1, 2, 4, 8, 16) are supported so an entry never straddles two words.
+class PackedArray
+{
+public:
+	PackedArray() { }
+	PackedArray(size_t count, uint8_t bits)
+	{
+		Allocate(count, bits);
+	}
+
+	~PackedArray()
+	{
+		Free();
+	}
+
+	PackedArray(const PackedArray& other)
+	{
+		*this = other;
+	}
+
+	PackedArray& operator=(const PackedArray& other)
+	{
+		if (this == &other)
+			return *this;
+		Free();
+		m_count = other.m_count;
+		m_bits = other.m_bits;
+		m_shift = other.m_shift;
+		m_mask = other.m_mask;
+		if (other.m_data)
+		{
+			m_data = (uint64_t*)SlabPool::Get().Allocate(GetWordCount() * sizeof(uint64_t));
+			memcpy(m_data, other.m_data, GetWordCount() * sizeof(uint64_t));
+		}
+		return *this;
+	}
+
+	PackedArray(PackedArray&& other) noexcept
+	{
+		*this = static_cast<PackedArray&&>(other);
+	}
+
+	PackedArray& operator=(PackedArray&& other) noexcept
+	{
+		if (this == &other)
+			return *this;
+		Free();
+		m_data = other.m_data;
+		m_count = other.m_count;
+		m_bits = other.m_bits;
+		m_shift = other.m_shift;
+		m_mask = other.m_mask;
+		other.m_data = nullptr;
+		other.m_count = 0;
+		other.m_bits = 0;
+		return *this;
+	}
+
+	void Allocate(size_t count, uint8_t bits)
+	{
+		assert(bits && bits <= 16 && (bits & (bits - 1)) == 0 && "Bit width must be a power of two up to 16.");
+
+		Free();
+		m_count = count;
+		SetBits(bits);
+		m_data = (uint64_t*)SlabPool::Get().Allocate(GetWordCount() * sizeof(uint64_t));
+		memset(m_data, 0, GetWordCount() * sizeof(uint64_t));
+	}
+
+	void Free()
+	{
+		SlabPool::Get().Free(m_data, GetWordCount() * sizeof(uint64_t));
+		m_data = nullptr;
+	}
+
+	uint32_t Get(size_t index) const
+	{
+		assert(index < m_count && "Reading out-of-bounds.");
+		assert(m_data && "Attempting to read from unallocated data");
+
+		size_t bit = index << m_shift;
+		return (uint32_t)(m_data[bit >> 6] >> (bit & 63)) & m_mask;
+	}
+
+	void Set(size_t index, uint32_t value)
+	{
+		assert(index < m_count && "Writing out-of-bounds.");
+		assert(m_data && "Attempting to write to unallocated data");
+		assert(value <= m_mask && "Value doesn't fit in the bit width.");
+
+		size_t bit = index << m_shift;
+		uint64_t& word = m_data[bit >> 6];
+		word &= ~((uint64_t)m_mask << (bit & 63));
+		word |= (uint64_t)value << (bit & 63);
+	}
+
+	// Bulk versions of Get and Set over every entry, a word at a time.
+	void Unpack(uint16_t* values) const
+	{
+		Unpack(0, m_count, values);
+	}
+
+	void Unpack(size_t start, size_t count, uint16_t* values) const
+	{
+		assert(start + count <= m_count && "Reading out-of-bounds.");
+		assert(m_data && "Attempting to read from unallocated data");
+
+		size_t bit = start << m_shift;
+		const uint64_t* word = m_data + (bit >> 6);
+		uint64_t bits = count ? *word >> (bit & 63) : 0;
+		size_t left = (64 - (bit & 63)) >> m_shift; // Entries left in the current word
+		for (size_t i = 0; i < count; i++, left--, bits >>= m_bits)
+		{
+			if (left == 0)
+			{
+				bits = *++word;
+				left = 64 >> m_shift;
+			}
+			values[i] = (uint16_t)(bits & m_mask);
+		}
+	}
+
+	void Pack(const uint16_t* values)
+	{
+		assert(m_data && "Attempting to write to unallocated data");
+
+		size_t perWord = 64 >> m_shift;
+		for (size_t w = 0, i = 0; i < m_count; w++)
+		{
+			uint64_t word = 0;
+			for (size_t j = 0; j < perWord && i < m_count; j++, i++)
+				word |= (uint64_t)values[i] << (j << m_shift);
+			m_data[w] = word;
+		}
+	}
+
+	// Repack every entry into a new bit width, values must fit in the new width.
+	void Resize(uint8_t newBits)
+	{
+		if (newBits == m_bits)
+			return;
+
+		PackedArray resized(m_count, newBits);
+		for (size_t i = 0; i < m_count; i++)
+			resized.Set(i, Get(i));
+		*this = static_cast<PackedArray&&>(resized);
+	}
+
+	uint8_t GetBits() const { return m_bits; }
+	size_t GetCount() const { return m_count; }
+	size_t GetWordCount() const { return ((m_count << m_shift) + 63) / 64; }
+	size_t GetMemoryUsage() const { return m_data ? GetWordCount() * sizeof(uint64_t) : 0; }
+	uint64_t* GetData() { return m_data; }
+	const uint64_t* GetData() const { return m_data; }
+
+private:
+	void SetBits(uint8_t bits)
+	{
+		m_bits = bits;
+		m_shift = 0;
+		while ((1u << m_shift) < bits)
+			m_shift++;
+		m_mask = (1u << bits) - 1;
+	}
+
+	uint64_t* m_data = nullptr;
+	size_t m_count = 0;
+	uint8_t m_bits = 0;
+	uint8_t m_shift = 0;
+	uint32_t m_mask = 0;
+};
\ No newline at end of file
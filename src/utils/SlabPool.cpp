@@ -0,0 +1,126 @@
+#include "SlabPool.h"
+
+#include <stdlib.h>
+#include <tracy/Tracy.hpp>
+
+#ifdef LINUX
+#include <sys/mman.h>
+#endif
+
+SlabPool& SlabPool::Get()
+{
+	// Never destroyed, block storage can still be freed by other statics during shutdown
+	static SlabPool* pool = new SlabPool();
+	return *pool;
+}
+
+int SlabPool::GetSizeClass(size_t size)
+{
+	if (size < MIN_BLOCK_SIZE || size > MAX_BLOCK_SIZE || (size & (size - 1)) != 0)
+		return -1;
+
+	int shift = MIN_SHIFT;
+	while (((size_t)1 << shift) < size)
+		shift++;
+	return shift - MIN_SHIFT;
+}
+
+char* SlabPool::AllocateSlab()
+{
+	ZoneScoped;
+
+#ifdef LINUX
+	void* slab = mmap(nullptr, SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (slab == MAP_FAILED)
+		return nullptr;
+#ifdef MADV_HUGEPAGE
+	madvise(slab, SLAB_SIZE, MADV_HUGEPAGE);
+#endif
+#else
+	void* slab = malloc(SLAB_SIZE);
+	if (!slab)
+		return nullptr;
+#endif
+
+	m_bytesReserved += SLAB_SIZE;
+	return (char*)slab;
+}
+
+void* SlabPool::Allocate(size_t size)
+{
+	int sizeClass = GetSizeClass(size);
+	if (sizeClass == -1)
+		return malloc(size);
+
+	void* data = nullptr;
+	{
+		SizeClass& blocks = m_sizeClasses[sizeClass];
+		std::lock_guard lock(blocks.mutex);
+
+		if (blocks.freeBlocks)
+		{
+			data = blocks.freeBlocks;
+			blocks.freeBlocks = blocks.freeBlocks->next;
+			m_reuses++;
+		}
+		else
+		{
+			if (blocks.slabUsed + size > SLAB_SIZE)
+			{
+				// The rest of the old slab is too small for this class and is left unused
+				blocks.slab = AllocateSlab();
+				blocks.slabUsed = blocks.slab ? 0 : SLAB_SIZE;
+			}
+
+			// Blocks from malloc when a slab can't be had join the free list like any other
+			if (blocks.slab && blocks.slabUsed + size <= SLAB_SIZE)
+			{
+				data = blocks.slab + blocks.slabUsed;
+				blocks.slabUsed += size;
+			}
+			else
+			{
+				data = malloc(size);
+				if (!data)
+					return nullptr;
+			}
+		}
+	}
+
+	m_allocations++;
+	size_t inUse = m_bytesInUse += size;
+	size_t highWaterMark = m_highWaterMark;
+	while (inUse > highWaterMark && !m_highWaterMark.compare_exchange_weak(highWaterMark, inUse)) { }
+
+	return data;
+}
+
+void SlabPool::Free(void* data, size_t size)
+{
+	if (!data)
+		return;
+
+	int sizeClass = GetSizeClass(size);
+	if (sizeClass == -1)
+	{
+		free(data);
+		return;
+	}
+
+	SizeClass& blocks = m_sizeClasses[sizeClass];
+	{
+		std::lock_guard lock(blocks.mutex);
+		FreeBlock* block = (FreeBlock*)data;
+		block->next = blocks.freeBlocks;
+		blocks.freeBlocks = block;
+	}
+	m_bytesInUse -= size;
+}
+
+void SlabPool::PlotStats() const
+{
+	TracyPlot("Block pool in use (MiB)", m_bytesInUse / (1024.0 * 1024.0));
+	TracyPlot("Block pool high water (MiB)", m_highWaterMark / (1024.0 * 1024.0));
+	TracyPlot("Block pool reserved (MiB)", m_bytesReserved / (1024.0 * 1024.0));
+	TracyPlot("Block pool reuse rate", GetReuseRate());
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+
+// Recycles power of two sized blocks of memory, used for chunk block storage so loading and
+// unloading chunks doesn't go through malloc. Blocks are carved out of large slabs which are
+// never given back, on Linux the slabs are backed by transparent huge pages where available.
+// Sizes outside of MIN_BLOCK_SIZE to MAX_BLOCK_SIZE fall back to malloc.
+class SlabPool
+{
+public:
+	static constexpr size_t MIN_BLOCK_SIZE = 64;
+	static constexpr size_t MAX_BLOCK_SIZE = 64 * 1024;
+	static constexpr size_t SLAB_SIZE = 2 * 1024 * 1024;
+
+	static SlabPool& Get();
+
+	// Memory isn't cleared, size must be the same when freeing.
+	void* Allocate(size_t size);
+	void Free(void* data, size_t size);
+
+	// Sends the stats below to Tracy's plots
+	void PlotStats() const;
+
+	size_t GetBytesInUse() const { return m_bytesInUse; }
+	size_t GetHighWaterMark() const { return m_highWaterMark; }
+	size_t GetBytesReserved() const { return m_bytesReserved; }
+	// Fraction of allocations that were handed a previously freed block
+	double GetReuseRate() const { return m_allocations ? (double)m_reuses / m_allocations : 0.0; }
+
+private:
+	struct FreeBlock
+	{
+		FreeBlock* next;
+	};
+
+	struct SizeClass
+	{
+		std::mutex mutex;
+		FreeBlock* freeBlocks = nullptr;
+		char* slab = nullptr;
+		size_t slabUsed = SLAB_SIZE;
+	};
+
+	static constexpr int MIN_SHIFT = 6;
+	static constexpr int MAX_SHIFT = 16;
+	static_assert((size_t)1 << MIN_SHIFT == MIN_BLOCK_SIZE && (size_t)1 << MAX_SHIFT == MAX_BLOCK_SIZE);
+
+	SlabPool() { }
+	static int GetSizeClass(size_t size);
+	char* AllocateSlab();
+
+	std::array<SizeClass, MAX_SHIFT - MIN_SHIFT + 1> m_sizeClasses;
+	std::atomic<size_t> m_bytesInUse = 0;
+	std::atomic<size_t> m_highWaterMark = 0;
+	std::atomic<size_t> m_bytesReserved = 0;
+	std::atomic<size_t> m_allocations = 0;
+	std::atomic<size_t> m_reuses = 0;
+};